@@ -0,0 +1,316 @@
+#!/usr/bin/perl
+#
+# bench.pl - Measure tsh's launch, signal and reap latencies
+#
+# The shell is driven over a pipe with -p, one command line at a time,
+# and each sample is the time from writing a line to reading back what
+# it prints (or a marker echoed after it). Samples are reported as
+# percentiles, and with -H as log2 histograms.
+#
+# Scenarios (all of them by default):
+#   turnaround  builtin round trip, and foreground /bin/true turnaround
+#   spawn       /bin/true turnaround launched with vfork, fork (-F) and
+#               the zygote (-z), and the shell's own vfork-to-exec time
+#   signal      ctrl-c and ctrl-z delivery, from the signal sent to the
+#               shell to its report of the job's end or stop
+#   reap        hundreds of background children exiting at once, until
+#               the shell has reaped them all
+#   jobs        job lookup and reap cost with 10 to 10,000 jobs
+#   pipe        bytes through a 3-stage pipeline
+#   script      commands per second of a script run with -f and -p
+#
+use strict;
+use warnings;
+use Getopt::Std;
+use POSIX qw(:sys_wait_h);
+use Fcntl qw(:flock);
+use Time::HiRes qw(sleep time);
+use File::Temp qw(tempdir);
+use IO::Handle;
+use Cwd qw(abs_path);
+
+sub usage {
+    print STDERR "usage: $0 [-hH] [-s shell] [-n count] [-j sizes] [-b bytes] [scenario ...]\n";
+    print STDERR "   -s shell  shell program to measure (default ./tsh)\n";
+    print STDERR "   -n count  samples per measurement (default 1000)\n";
+    print STDERR "   -j sizes  job counts for the jobs scenario (default 10,100,1000,10000)\n";
+    print STDERR "   -b bytes  bytes through the pipeline, with k, M or G (default 1G)\n";
+    print STDERR "   -H        print histograms as well as percentiles\n";
+    print STDERR "scenarios: turnaround spawn signal reap jobs pipe script\n";
+    exit(1);
+}
+
+our ($opt_h, $opt_H, $opt_s, $opt_n, $opt_j, $opt_b);
+getopts('hHs:n:j:b:') or usage();
+usage() if $opt_h;
+my $shell = $opt_s // "./tsh";
+my $count = $opt_n // 1000;
+my @sizes = split(/,/, $opt_j // "10,100,1000,10000");
+my $size = $opt_b // "1G";
+my $bytes = $size;
+$bytes = $1 * {'' => 1, k => 1 << 10, M => 1 << 20, G => 1 << 30}->{$2}
+    if $bytes =~ /^(\d+)([kMG]?)$/;
+my %scenarios = (turnaround => \&turnaround, spawn => \&spawn,
+                 signal => \&signal, reap => \&reap, jobs => \&jobs,
+                 pipe => \&pipeline, script => \&script);
+my @run = @ARGV ? @ARGV : qw(turnaround spawn signal reap jobs pipe script);
+foreach (@run) {
+    usage() unless $scenarios{$_};
+}
+-x $shell or die "$0: $shell: not executable\n";
+$shell = abs_path($shell);
+$SIG{PIPE} = 'IGNORE';
+my $tmp = tempdir(CLEANUP => 1);
+
+foreach (@run) {
+    print "== $_\n";
+    $scenarios{$_}->();
+}
+exit(0);
+
+#
+# Reporting
+#
+
+# fmt - A duration in seconds, in a readable unit
+sub fmt {
+    my ($t) = @_;
+    return sprintf("%.0fns", $t * 1e9) if $t < 1e-6;
+    return sprintf("%.1fus", $t * 1e6) if $t < 1e-3;
+    return sprintf("%.2fms", $t * 1e3) if $t < 1;
+    return sprintf("%.2fs", $t);
+}
+
+# report - Print the percentiles (and histogram) of some samples
+sub report {
+    my ($name, @s) = @_;
+    @s = sort { $a <=> $b } @s;
+    my $n = @s;
+    return printf("%-28s no samples\n", $name) if $n == 0;
+    my $sum = 0;
+    $sum += $_ foreach @s;
+    my $pct = sub { $s[int($_[0] * ($n - 1) + 0.5)] };
+    printf("%-28s n=%-6d mean %-9s p50 %-9s p90 %-9s p99 %-9s max %s\n",
+           $name, $n, fmt($sum / $n), fmt($pct->(0.5)), fmt($pct->(0.9)),
+           fmt($pct->(0.99)), fmt($s[-1]));
+    return unless $opt_H;
+    my %hist;
+    foreach (@s) {
+        my $b = $_ > 1e-9 ? int(log($_ * 1e9) / log(2)) : 0;
+        $hist{$b}++;
+    }
+    my $most = (sort { $b <=> $a } values(%hist))[0];
+    foreach my $b (sort { $a <=> $b } keys(%hist)) {
+        printf("    %9s - %-9s %7d %s\n", fmt((1 << $b) / 1e9),
+               fmt((2 << $b) / 1e9), $hist{$b},
+               '#' x int(50 * $hist{$b} / $most + 0.5));
+    }
+}
+
+#
+# Talking to the shell
+#
+
+# start - Run the shell with some options, reading commands from a pipe
+# and writing to another
+sub start {
+    my @args = @_;
+    pipe(my $crd, my $cwr) or die "$0: pipe: $!\n";
+    pipe(my $ord, my $owr) or die "$0: pipe: $!\n";
+    my $pid = fork();
+    die "$0: fork: $!\n" unless defined($pid);
+    if ($pid == 0) {
+        close($cwr);
+        close($ord);
+        chdir($tmp);
+        open(STDIN, '<&', $crd) or die;
+        open(STDOUT, '>&', $owr) or die;
+        $SIG{INT} = $SIG{TSTP} = $SIG{PIPE} = 'DEFAULT';
+        exec($shell, "-p", @args) or die "$0: $shell: $!\n";
+    }
+    close($crd);
+    close($owr);
+    $cwr->autoflush(1);
+    return {pid => $pid, in => $cwr, out => $ord, buf => "", marks => 0};
+}
+
+# send - Send the shell a command line
+sub send_line {
+    my ($sh, $line) = @_;
+    print {$sh->{in}} "$line\n";
+}
+
+# expect - Read the shell's output up to a line matching a pattern, and
+# return the time it came (the line is left in $sh->{line})
+sub expect {
+    my ($sh, $re) = @_;
+    for (;;) {
+        while ($sh->{buf} =~ s/^([^\n]*)\n//) {
+            my $line = $1;
+            if ($line =~ $re) {
+                $sh->{line} = $line;
+                return time();
+            }
+        }
+        my $n = sysread($sh->{out}, $sh->{buf}, 65536, length($sh->{buf}));
+        die "$0: the shell exited before printing $re\n" unless $n;
+    }
+}
+
+# sync - Wait until the shell has run everything sent so far
+sub sync {
+    my ($sh) = @_;
+    my $mark = "\@mark" . ++$sh->{marks};
+    send_line($sh, "echo $mark");
+    return expect($sh, qr/^\Q$mark\E$/);
+}
+
+# finish - Make the shell quit and return what it printed in the end
+sub finish {
+    my ($sh) = @_;
+    send_line($sh, "quit");
+    close($sh->{in});
+    my $rest = $sh->{buf};
+    while (sysread($sh->{out}, $rest, 65536, length($rest))) { }
+    waitpid($sh->{pid}, 0);
+    return $rest;
+}
+
+# roundtrip - Time a command line and the marker echoed after it
+sub roundtrip {
+    my ($sh, $line, $n) = @_;
+    my @s;
+    foreach (1 .. $n) {
+        my $t0 = time();
+        send_line($sh, $line);
+        push(@s, sync($sh) - $t0);
+    }
+    return @s;
+}
+
+#
+# Scenarios
+#
+
+sub turnaround {
+    my $sh = start();
+    report("builtin (echo)", roundtrip($sh, "echo x", $count));
+    report("foreground /bin/true", roundtrip($sh, "/bin/true", $count));
+    finish($sh);
+}
+
+sub spawn {
+    foreach my $mode (["vfork"], ["fork", "-F"], ["zygote", "-z"]) {
+        my ($name, @args) = @$mode;
+        my $sh = start(@args);
+        roundtrip($sh, "stats", 1);
+        report("/bin/true ($name)", roundtrip($sh, "/bin/true", $count));
+        send_line($sh, "stats");
+        expect($sh, qr/^exec\s/);
+        print("    $sh->{line}\n") unless $sh->{line} =~ /^exec\s+0$/;
+        finish($sh);
+    }
+}
+
+sub signal {
+    my $n = $count > 200 ? 200 : $count;
+    foreach my $sig (["ctrl-c", "INT", qr/terminated by signal 2$/],
+                     ["ctrl-z", "TSTP", qr/stopped by signal 20$/]) {
+        my ($name, $signo, $re) = @$sig;
+        my $sh = start();
+        my @s;
+        foreach (1 .. $n) {
+            send_line($sh, "/bin/sleep 10");
+            sleep(0.01);
+            my $t0 = time();
+            kill($signo, $sh->{pid});
+            push(@s, expect($sh, $re) - $t0);
+            send_line($sh, "kill -KILL %1");
+            send_line($sh, "wait");
+            sync($sh);
+        }
+        report("$name delivery", @s);
+        finish($sh);
+    }
+}
+
+# hold - Launch jobs that block until the lock is let go, all at once
+sub hold {
+    my ($sh, $n) = @_;
+    open(my $lock, '>', "$tmp/lock") or die "$0: $tmp/lock: $!\n";
+    flock($lock, LOCK_EX) or die "$0: flock: $!\n";
+    foreach my $i (1 .. $n) {  # syncing now and then, so neither pipe fills up
+        send_line($sh, "/usr/bin/flock -s lock /bin/true &");
+        sync($sh) if $i % 100 == 0 || $i == $n;
+    }
+    sleep(0.2 + $n / 2000);
+    return $lock;
+}
+
+sub reap {
+    my $n = 200;
+    my $rounds = $count > 20 ? 20 : $count;
+    my $sh = start();
+    my @s;
+    foreach (1 .. $rounds) {
+        my $lock = hold($sh, $n);
+        send_line($sh, "wait");
+        my $t0 = time();
+        close($lock);
+        push(@s, sync($sh) - $t0);
+    }
+    report("reap $n children", @s);
+    printf("    %.0f children/s at p50\n", $n / (sort { $a <=> $b } @s)[@s / 2]);
+    finish($sh);
+}
+
+sub jobs {
+    foreach my $n (@sizes) {
+        my $sh = start();
+        my $lock = hold($sh, $n);
+        my @s;
+        foreach (1 .. $count) {
+            my $jid = 1 + int(rand($n));
+            my $t0 = time();
+            send_line($sh, "kill -0 %$jid");
+            push(@s, sync($sh) - $t0);
+        }
+        report("kill -0 %N of $n jobs", @s);
+        send_line($sh, "wait");
+        my $t0 = time();
+        close($lock);
+        my $t = sync($sh) - $t0;
+        printf("    reaping them: %s, %s per job\n", fmt($t), fmt($t / $n));
+        finish($sh);
+    }
+}
+
+sub pipeline {
+    my $sh = start();
+    my $t0 = time();
+    send_line($sh, "/bin/cat /dev/zero | /usr/bin/head -c $bytes | /usr/bin/wc -c");
+    expect($sh, qr/^\d+$/);
+    my $t = time() - $t0;
+    printf("%-28s %s, %.2f GB/s\n", "3-stage pipeline, $size",
+           fmt($t), $bytes / $t / 1e9);
+    finish($sh);
+}
+
+sub script {
+    my $n = $count * 20;
+    open(my $f, '>', "$tmp/script") or die "$0: $tmp/script: $!\n";
+    print $f "/bin/true\n" x $n;
+    close($f);
+    foreach my $mode (["-f", "-f", "$tmp/script"], ["-p", "-p"]) {
+        my ($name, @args) = @$mode;
+        my $t0 = time();
+        my $pid = fork();
+        if ($pid == 0) {
+            open(STDIN, '<', "$tmp/script") or die;
+            exec($shell, @args) or die "$0: $shell: $!\n";
+        }
+        waitpid($pid, 0);
+        my $t = time() - $t0;
+        printf("%-28s %s, %.0f commands/s\n", "$n commands ($name)", fmt($t), $n / $t);
+    }
+}
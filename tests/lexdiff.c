@@ -0,0 +1,227 @@
+/*
+ * lexdiff.c - Differential test of parseline() against the original one
+ *
+ * Random command lines are built from what the original parseline()
+ * understood: words of ordinary characters separated by runs of
+ * spaces, words in single quotes, and a final "&". Both parsers must
+ * split every line into the same words and agree on the background
+ * flag. With -b, both are also timed on the same lines.
+ *
+ * usage: lexdiff [-b] [-n lines] [-s seed]
+ */
+#define main tsh_main
+#include "../tsh.c"
+#undef main
+
+#define OLDMAXARGS 128   /* the original limits */
+#define OLDMAXLINE 1024
+
+/*
+ * oldparseline - parseline() as it was before the tokenizer, with
+ *     strchr() splitting on single spaces and single quotes only
+ */
+int oldparseline(const char *cmdline, char **argv)
+{
+    static char array[OLDMAXLINE]; /* holds local copy of command line */
+    char *buf = array;          /* ptr that traverses command line */
+    char *delim;                /* points to first space delimiter */
+    int argc;                   /* number of args */
+    int bg;                     /* background job? */
+
+    strcpy(buf, cmdline);
+    buf[strlen(buf)-1] = ' ';  /* replace trailing '\n' with space */
+    while (*buf && (*buf == ' ')) /* ignore leading spaces */
+	buf++;
+
+    /* Build the argv list */
+    argc = 0;
+    if (*buf == '\'') {
+	buf++;
+	delim = strchr(buf, '\'');
+    }
+    else {
+	delim = strchr(buf, ' ');
+    }
+
+    while (delim) {
+	argv[argc++] = buf;
+	*delim = '\0';
+	buf = delim + 1;
+	while (*buf && (*buf == ' ')) /* ignore spaces */
+	       buf++;
+
+	if (*buf == '\'') {
+	    buf++;
+	    delim = strchr(buf, '\'');
+	}
+	else {
+	    delim = strchr(buf, ' ');
+	}
+    }
+    argv[argc] = NULL;
+
+    if (argc == 0)  /* ignore blank line */
+	return 1;
+
+    /* should the job run in the background? */
+    if ((bg = (*argv[argc-1] == '&')) != 0) {
+	argv[--argc] = NULL;
+    }
+    return bg;
+}
+
+/* Characters that mean nothing special to either parser */
+static const char plain[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+    "-_./=:,+%@^~$#!{}()";
+
+/* Corner cases the original parser understood */
+static const char *fixed[] = {
+    "\n", "   \n", "/bin/ls -l\n", "  /bin/echo  hello   world  \n",
+    "'a b' c\n", "echo '' x\n", "x 'a  b'\n", "sleep 1 &\n", "sleep 1 & \n",
+    "&\n",
+};
+
+/*
+ * genline - Write a random command line of at most size bytes,
+ *     ending with a newline, into buf
+ */
+void genline(char *buf, size_t size)
+{
+    char *p = buf;
+    char *end = buf + size - 8;
+    int nwords = random() % 12;
+    int i, n;
+
+    for (n = random() % 3; n > 0; n--)
+	*p++ = ' ';
+    while (nwords-- > 0 && end - p > 64) {
+	if (random() % 4 == 0) {  /* a quoted word, maybe empty, spaces allowed */
+	    *p++ = '\'';
+	    for (n = random() % 10; n > 0; n--)
+		*p++ = random() % 5 == 0 ? ' ' : plain[random() % (sizeof(plain) - 1)];
+	    *p++ = '\'';
+	}
+	else {
+	    for (n = 1 + random() % 10; n > 0; n--)
+		*p++ = plain[random() % (sizeof(plain) - 1)];
+	}
+	for (i = 0, n = 1 + random() % 3; i < n; i++)
+	    *p++ = ' ';
+    }
+    if (p > buf && random() % 3 == 0) {
+	strcpy(p, "& ");
+	p += random() % 2 + 1;
+    }
+    *p++ = '\n';
+    *p = '\0';
+}
+
+/*
+ * compare - Parse a line both ways and print the difference, if any;
+ *     return 0 if they agree
+ */
+int compare(const char *line)
+{
+    char *oldargv[OLDMAXARGS];
+    char **argv;
+    int oldbg, bg, i;
+
+    oldbg = oldparseline(line, oldargv);
+    bg = parseline(line, &argv);
+    for (i = 0; oldargv[i] != NULL && argv[i] != NULL; i++)
+	if (strcmp(oldargv[i], argv[i]) != 0)
+	    break;
+    if (oldbg == bg && oldargv[i] == NULL && argv[i] == NULL) {
+	arena_reset();
+	return 0;
+    }
+
+    printf("line: \"%.*s\"\n", (int)strlen(line) - 1, line);
+    printf("  old (bg=%d):", oldbg);
+    for (i = 0; oldargv[i] != NULL; i++)
+	printf(" [%s]", oldargv[i]);
+    printf("\n  new (bg=%d):", bg);
+    for (i = 0; bg >= 0 && argv[i] != NULL; i++)
+	printf(" [%s]", argv[i]);
+    printf("\n");
+    arena_reset();
+    return 1;
+}
+
+/*
+ * timeparse - Return the mean time in ns either parser takes on lines
+ */
+double timeparse(char (*lines)[OLDMAXLINE], int n, int old)
+{
+    char *oldargv[OLDMAXARGS];
+    char **argv;
+    long long t0;
+    int i, round;
+
+    t0 = ph_now();
+    for (round = 0; round < 10; round++) {
+	for (i = 0; i < n; i++) {
+	    if (old)
+		oldparseline(lines[i], oldargv);
+	    else {
+		parseline(lines[i], &argv);
+		arena_reset();
+	    }
+	}
+    }
+    return (double)(ph_now() - t0) / (10.0 * n);
+}
+
+int main(int argc, char **argv)
+{
+    char (*lines)[OLDMAXLINE];
+    char buf[OLDMAXLINE];
+    int n = 100000;
+    int bench = 0;
+    int fails = 0;
+    unsigned seed = 1;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "bn:s:")) != EOF) {
+	switch (c) {
+	case 'b':
+	    bench = 1;
+	    break;
+	case 'n':
+	    n = atoi(optarg);
+	    break;
+	case 's':
+	    seed = strtoul(optarg, NULL, 10);
+	    break;
+	default:
+	    printf("usage: %s [-b] [-n lines] [-s seed]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    srandom(seed);
+
+    for (i = 0; i < (int)(sizeof(fixed) / sizeof(fixed[0])); i++)
+	fails += compare(fixed[i]);
+
+    for (i = 0; i < n; i++) {
+	genline(buf, sizeof(buf));
+	if (compare(buf) && ++fails >= 10)
+	    break;
+    }
+    if (fails) {
+	printf("%d lines differ\n", fails);
+	exit(1);
+    }
+    printf("%d random lines parse the same\n", n);
+
+    if (bench) {
+	if ((lines = malloc(10000 * sizeof(*lines))) == NULL)
+	    unix_error("malloc");
+	for (i = 0; i < 10000; i++)
+	    genline(lines[i], sizeof(lines[i]));
+	printf("old parseline: %.0f ns/line\n", timeparse(lines, 10000, 1));
+	printf("new parseline: %.0f ns/line\n", timeparse(lines, 10000, 0));
+    }
+    exit(0);
+}
@@ -0,0 +1,39 @@
+#!/bin/sh
+#
+# runtests.sh - Run each tests/traceNN.txt through the shell and compare
+# its output, PIDs aside, with tests/traceNN.out
+#
+# usage: runtests.sh [shell [trace ...]]
+#
+# Each trace runs in an empty scratch directory. Set UPDATE=1 to write
+# the .out files from the current output instead.
+#
+dir=$(cd "$(dirname "$0")" && pwd)
+shell=$(cd "$(dirname "${1:-./tsh}")" && pwd)/$(basename "${1:-./tsh}")
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] || set -- "$dir"/trace*.txt
+
+pass=0
+fail=0
+for trace in "$@"; do
+    trace=$(cd "$(dirname "$trace")" && pwd)/$(basename "$trace")
+    name=$(basename "$trace" .txt)
+    ref=${trace%.txt}.out
+    tmp=$(mktemp -d) || exit 1
+    (cd "$tmp" && perl "$dir/sdriver.pl" -n -t "$trace" -s "$shell") > "$tmp.out" 2>&1
+    if [ -n "$UPDATE" ]; then
+        cp "$tmp.out" "$ref"
+        echo "$name: updated"
+    elif diff -u "$ref" "$tmp.out" > "$tmp.diff"; then
+        echo "$name: ok"
+        pass=$((pass + 1))
+    else
+        echo "$name: FAILED"
+        cat "$tmp.diff"
+        fail=$((fail + 1))
+    fi
+    rm -rf "$tmp" "$tmp.out" "$tmp.diff"
+done
+[ -n "$UPDATE" ] && exit 0
+echo "$pass passed, $fail failed"
+[ $fail -eq 0 ]
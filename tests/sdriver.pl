@@ -0,0 +1,115 @@
+#!/usr/bin/perl
+#
+# sdriver.pl - Drive tsh from a trace file over a pipe
+#
+# Each line of the trace is sent to the shell's stdin, except for
+# these directives:
+#   # ...       a comment (a first "# args: ..." line gives the
+#               shell's options when -a isn't used)
+#   SLEEP n     wait n seconds (fractions allowed) before going on
+#   INT, TSTP   send SIGINT (SIGTSTP) to the shell, as ctrl-c (ctrl-z)
+#   CLOSE       close the shell's stdin
+#   WAIT        wait for the shell to exit
+#
+# The shell's stdout (tsh sends its stderr there too) is printed once
+# the shell has exited. With -n, PIDs are replaced by "PID" so that
+# the output can be compared with a reference.
+#
+use strict;
+use warnings;
+use Getopt::Std;
+use POSIX qw(:sys_wait_h);
+use Time::HiRes qw(sleep time);
+use File::Temp qw(tempfile);
+use IO::Handle;
+
+sub usage {
+    print STDERR "usage: $0 [-hvn] -t <trace> -s <shell> [-a <args>] [-T <secs>]\n";
+    print STDERR "   -t <trace>  trace file\n";
+    print STDERR "   -s <shell>  shell program to test\n";
+    print STDERR "   -a <args>   shell arguments (default from the trace, else \"-p\")\n";
+    print STDERR "   -T <secs>   kill the shell after secs seconds (default 20)\n";
+    print STDERR "   -n          replace PIDs in the output by PID\n";
+    print STDERR "   -v          print each command as it is sent\n";
+    exit(1);
+}
+
+our ($opt_h, $opt_v, $opt_n, $opt_t, $opt_s, $opt_a, $opt_T);
+getopts('hvnt:s:a:T:') or usage();
+usage() if $opt_h || !defined($opt_t) || !defined($opt_s);
+my $timeout = defined($opt_T) ? $opt_T : 20;
+
+open(my $trace, '<', $opt_t) or die "$0: $opt_t: $!\n";
+my @lines = <$trace>;
+close($trace);
+
+my $args = $opt_a;
+if (!defined($args)) {
+    $args = (@lines && $lines[0] =~ /^#\s*args:\s*(.*?)\s*$/) ? $1 : "-p";
+}
+
+# The shell writes into a file, so that it never blocks on a full pipe
+my ($out, $outname) = tempfile(UNLINK => 1);
+pipe(my $rd, my $wr) or die "$0: pipe: $!\n";
+my $pid = fork();
+die "$0: fork: $!\n" unless defined($pid);
+if ($pid == 0) {
+    close($wr);
+    open(STDIN, '<&', $rd) or die "$0: dup: $!\n";
+    open(STDOUT, '>&', $out) or die "$0: dup: $!\n";
+    open(STDERR, '>&', $out) or die "$0: dup: $!\n";
+    $SIG{INT} = $SIG{TSTP} = $SIG{PIPE} = 'DEFAULT';
+    exec($opt_s, split(' ', $args)) or die "$0: $opt_s: $!\n";
+}
+close($rd);
+$wr->autoflush(1);
+$SIG{PIPE} = 'IGNORE';
+
+my $status;
+sub reap {
+    my ($secs) = @_;
+    my $deadline = time() + $secs;
+    while (!defined($status)) {
+        if (waitpid($pid, WNOHANG) == $pid) {
+            $status = $?;
+            last;
+        }
+        if (time() >= $deadline) {
+            kill('KILL', $pid);
+            waitpid($pid, 0);
+            print STDERR "$0: $opt_t: the shell did not exit within ${timeout}s\n";
+            $status = -1;
+            last;
+        }
+        sleep(0.005);
+    }
+}
+
+my $start = time();
+foreach my $line (@lines) {
+    chomp($line);
+    next if $line =~ /^#/;
+    if ($line =~ /^SLEEP\s+([\d.]+)\s*$/) {
+        sleep($1);
+    } elsif ($line =~ /^(INT|TSTP)\s*$/) {
+        kill($1, $pid);
+    } elsif ($line =~ /^CLOSE\s*$/) {
+        close($wr);
+    } elsif ($line =~ /^WAIT\s*$/) {
+        close($wr);
+        reap($timeout - (time() - $start));
+    } else {
+        print STDERR "$line\n" if $opt_v;
+        print $wr "$line\n";
+    }
+}
+close($wr);
+reap($timeout - (time() - $start));
+
+open(my $res, '<', $outname) or die "$0: $outname: $!\n";
+while (my $line = <$res>) {
+    $line =~ s/\((\d+)\)/(PID)/g if $opt_n;
+    print $line;
+}
+close($res);
+exit($status == 0 ? 0 : 1);
@@ -1,732 +1,6955 @@
-/* 
- * tsh - A tiny shell program with job control
- * 
- * Name: Meet Pravinbhai Sinojia
- * ID: 201601126
- * Email: 201601126@daiict.ac.in
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <string.h>
-#include <ctype.h>
-#include <signal.h>
-#include <sys/types.h>
-#include <sys/wait.h>
-#include <errno.h>
-
-/* Misc manifest constants */
-#define MAXLINE    1024   /* max line size */
-#define MAXARGS     128   /* max args on a command line */
-#define MAXJOBS      16   /* max jobs at any point in time */
-#define MAXJID    1<<16   /* max job ID */
-
-/* Job states */
-#define UNDEF 0 /* undefined */
-#define FG 1    /* running in foreground */
-#define BG 2    /* running in background */
-#define ST 3    /* stopped */
-
-/* 
- * Jobs states: FG (foreground), BG (background), ST (stopped)
- * Job state transitions and enabling actions:
- *     FG -> ST  : ctrl-z
- *     ST -> FG  : fg command
- *     ST -> BG  : bg command
- *     BG -> FG  : fg command
- * At most 1 job can be in the FG state.
- */
-
-/* Global variables */
-extern char **environ;      /* defined in libc */
-char prompt[] = "tsh> ";    /* command line prompt (DO NOT CHANGE) */
-int verbose = 0;            /* if true, print additional output */
-int nextjid = 1;            /* next job ID to allocate */
-char sbuf[MAXLINE];         /* for composing sprintf messages */
-
-struct job_t {              /* The job struct */
-    pid_t pid;              /* job PID */
-    int jid;                /* job ID [1, 2, ...] */
-    int state;              /* UNDEF, BG, FG, or ST */
-    char cmdline[MAXLINE];  /* command line */
-};
-struct job_t jobs[MAXJOBS]; /* The job list */
-/* End global variables */
-
-
-/* Function prototypes */
-
-/* Here are the functions that you will implement */
-void eval(char *cmdline);
-int builtin_cmd(char **argv);
-void do_bgfg(char **argv);
-void waitfg(pid_t pid);
-
-void sigchld_handler(int sig);
-void sigtstp_handler(int sig);
-void sigint_handler(int sig);
-
-/* Here are helper routines that we've provided for you */
-int parseline(const char *cmdline, char **argv); 
-void sigquit_handler(int sig);
-
-void clearjob(struct job_t *job);
-void initjobs(struct job_t *jobs);
-int maxjid(struct job_t *jobs); 
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline);
-int deletejob(struct job_t *jobs, pid_t pid); 
-pid_t fgpid(struct job_t *jobs);
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid);
-struct job_t *getjobjid(struct job_t *jobs, int jid); 
-int pid2jid(pid_t pid); 
-void listjobs(struct job_t *jobs);
-
-void usage(void);
-void unix_error(char *msg);
-void app_error(char *msg);
-typedef void handler_t(int);
-handler_t *Signal(int signum, handler_t *handler);
-
-/*
- * main - The shell's main routine 
- */
-int main(int argc, char **argv) 
-{
-    char c;
-    char cmdline[MAXLINE];
-    int emit_prompt = 1; /* emit prompt (default) */
-
-    /* Redirect stderr to stdout (so that driver will get all output
-     * on the pipe connected to stdout) */
-    dup2(1, 2);
-
-    /* Parse the command line */
-    while ((c = getopt(argc, argv, "hvp")) != EOF) {
-        switch (c) {
-        case 'h':             /* print help message */
-            usage();
-	    break;
-        case 'v':             /* emit additional diagnostic info */
-            verbose = 1;
-	    break;
-        case 'p':             /* don't print a prompt */
-            emit_prompt = 0;  /* handy for automatic testing */
-	    break;
-	default:
-            usage();
-	}
-    }
-
-    /* Install the signal handlers */
-
-    /* These are the ones you will need to implement */
-    Signal(SIGINT,  sigint_handler);   /* ctrl-c */
-    Signal(SIGTSTP, sigtstp_handler);  /* ctrl-z */
-    Signal(SIGCHLD, sigchld_handler);  /* Terminated or stopped child */
-
-    /* This one provides a clean way to kill the shell */
-    Signal(SIGQUIT, sigquit_handler); 
-
-    /* Initialize the job list */
-    initjobs(jobs);
-
-    /* Execute the shell's read/eval loop */
-    while (1) {
-
-	/* Read command line */
-	if (emit_prompt) {
-	    printf("%s", prompt);
-	    fflush(stdout);
-	}
-	if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
-	    app_error("fgets error");
-	if (feof(stdin)) { /* End of file (ctrl-d) */
-	    fflush(stdout);
-	    exit(0);
-	}
-
-	/* Evaluate the command line */
-	eval(cmdline);
-	fflush(stdout);
-	fflush(stdout);
-    } 
-
-    exit(0); /* control never reaches here */
-}
-  
-/* 
- * eval - Evaluate the command line that the user has just typed in
- * 
- * If the user has requested a built-in command (quit, jobs, bg or fg)
- * then execute it immediately. Otherwise, fork a child process and
- * run the job in the context of the child. If the job is running in
- * the foreground, wait for it to terminate and then return.  Note:
- * each child process must have a unique process group ID so that our
- * background children don't receive SIGINT (SIGTSTP) from the kernel
- * when we type ctrl-c (ctrl-z) at the keyboard.  
-*/
-void eval(char *cmdline) 
-{
-    char *argv[MAXARGS];  //String array to store arguments provided in command line
-
-    /*
-     * Parseline function is used to break command-line string into different arguments and storing them in argv[] array.
-     * It also checks if last character is '&'. If so, it returns 1 to indicate that the process is to be run in background.
-     */
-    int isBG = parseline(cmdline,argv);
-    
-
-    if(argv[0]==NULL){ //If user just press ENTER without typing any command, do nothing and give prompt back
-        return;
-    }
-
-    sigset_t sSet;
-    sigemptyset(&sSet);             //creating an empty sigset
-    sigaddset(&sSet, SIGCHLD);      //adding SIGCHLD in the set
-
-    pid_t cpid;
-    /*
-     * If user entered a built-in command, then function builtin_cmd() executes the command and returns true.
-     * In that case, condition inside if evaluates to be false. 
-     * Otherwise, the if condition evaluates to true and command is run using fork() and exec(). 
-     */
-    if(!builtin_cmd(argv)){
-        sigprocmask(SIG_BLOCK, &sSet, NULL); //Block SIGCHLD while parent forks to avoid race-condition
-        if((cpid=fork())==0){
-            setpgid(0,0); //Create a new process group with child as leader
-            if(execvp(argv[0],argv)<0){ //exec to run command in newly created process
-                printf("%s: Command not found\n",argv[0]); //Give error if exec fails (due to bad command) and terminate child process
-                exit(0);
-            }
-        }
-
-        if(isBG){   //For backgroung process
-            addjob(jobs,cpid,BG,cmdline); //Add job to the job-table
-            sigprocmask(SIG_UNBLOCK, &sSet, NULL); //Unblock SIGCHLD
-            printf("[%d] (%d) %s",pid2jid(cpid),cpid,cmdline); //Print process-ID and job-ID of the job created
-        }
-
-        else{      //for foreground process
-            addjob(jobs,cpid,FG,cmdline); //Add job to the job-table
-            sigprocmask(SIG_UNBLOCK, &sSet, NULL); //Unblock SIGCHLD
-            waitfg(cpid); //Wait for job to finish, and then give prompt back to the user
-        }
-    }
-
-    return;
-}
-
-/* 
- * parseline - Parse the command line and build the argv array.
- * 
- * Characters enclosed in single quotes are treated as a single
- * argument.  Return true if the user has requested a BG job, false if
- * the user has requested a FG job.  
- */
-int parseline(const char *cmdline, char **argv) 
-{
-    static char array[MAXLINE]; /* holds local copy of command line */
-    char *buf = array;          /* ptr that traverses command line */
-    char *delim;                /* points to first space delimiter */
-    int argc;                   /* number of args */
-    int bg;                     /* background job? */
-
-    strcpy(buf, cmdline);
-    buf[strlen(buf)-1] = ' ';  /* replace trailing '\n' with space */
-    while (*buf && (*buf == ' ')) /* ignore leading spaces */
-	buf++;
-
-    /* Build the argv list */
-    argc = 0;
-    if (*buf == '\'') {
-	buf++;
-	delim = strchr(buf, '\'');
-    }
-    else {
-	delim = strchr(buf, ' ');
-    }
-
-    while (delim) {
-	argv[argc++] = buf;
-	*delim = '\0';
-	buf = delim + 1;
-	while (*buf && (*buf == ' ')) /* ignore spaces */
-	       buf++;
-
-	if (*buf == '\'') {
-	    buf++;
-	    delim = strchr(buf, '\'');
-	}
-	else {
-	    delim = strchr(buf, ' ');
-	}
-    }
-    argv[argc] = NULL;
-    
-    if (argc == 0)  /* ignore blank line */
-	return 1;
-
-    /* should the job run in the background? */
-    if ((bg = (*argv[argc-1] == '&')) != 0) {
-	argv[--argc] = NULL;
-    }
-    return bg;
-}
-
-/* 
- * builtin_cmd - If the user has typed a built-in command, then execute it using this function.  
- */
-int builtin_cmd(char **argv) 
-{
-    /*quit command*/
-    if(strcmp(argv[0],"quit")==0){
-        int i;
-	    for(i=0;i<MAXJOBS;i++){ //If there are any jobs in ST (Stopped) state, then give error and do not quit
-            if(jobs[i].state==ST){    
-                printf("There are some processes in stopped state so can't quit\n");
-                return 1;
-            }
-        }
-        exit(0); //If not job in ST state, then quit.
-    }
-
-    /*jobs command*/
-    else if(strcmp(argv[0],"jobs")==0){
-	    listjobs(jobs); //list all jobs present in job-table using helper listjobs() function
-	    return 1;
-    }
-
-    /*bg or fg commands*/
-    else if(strcmp(argv[0],"fg")==0 || strcmp(argv[0],"bg")==0){
-	    do_bgfg(argv); //Put specified job in background or foreground with helper dp_bgfg() function
-	    return 1;
-    }
-    return 0;  /* return 0 if it is not a built-in command, so eval function will take care of it. */
-}
-
-/* 
- * do_bgfg - Execute the builtin bg and fg commands
- */
-void do_bgfg(char **argv) 
-{
-    /*First check for invalid (or missing) arguments*/
-
-    if(argv[1]==NULL){ //if no argument provided
-        printf("fd command requires PID or %cjobid argument\n",'%');
-        return;
-    }
-
-    int L=strlen(argv[1]); //stores length of argument provided to fg or bg command
-
-    if(argv[1][0]=='%'){ //if first character in argv[1] is '%', it means job-ID must be provided
-        for(int i=1;i<L;i++){ 
-            if(!(argv[1][i]>='0' && argv[1][i]<='9')){ //if any of next character is not a digit, then it cannot be a valid JID.
-                printf("fg: argument must be a PID or %cjobid\n",'%');
-                return;
-            }
-        }
-    }
-
-    else{
-        for(int i=0;i<L;i++){ //if first character in argv[1] is not '%', then it must be a PID
-            if(!(argv[1][i]>='0' && argv[1][i]<='9')){
-                printf("fg: argument must be a PID or %cjobid\n",'%'); //if any character is not a digit, it cannot be a valid PID
-                return;
-            }
-        }
-    }
-
-    int num;    //we will store the PID or JID provided as argument here
-
-    struct job_t *jobsPtr;      //this will point to job entry in job-table if provided PID or JID is valid
-
-
-    /*Next part is to extract PID or JID from argument provided*/
-
-    if(argv[1][0]=='%'){ //if it is JID, skip first character and store remaining in a string
-        char tem[L-1]; //to store JID in string format
-
-        int i;
-        for(i=1;i<L;i++){
-        tem[i-1]=argv[1][i];
-        }
-        
-        num = atoi(tem); //obtain JID in number form from string form
-    }
-
-    
-    else{ //if it is PID, argv[1] already contains PID in string form
-        num = atoi(argv[1]); //convert it to numerical form
-    }
-
-
-    /*Next part is to get job entry corresponding to given PID or JID*/
-
-    if(argv[1][0]=='%'){
-        jobsPtr=getjobjid(jobs,num);    //search job-table by JID
-    }
-
-    else{
-        jobsPtr=getjobpid(jobs,num);    //search job-table by PID
-    }
-
-    /* If given JID/PID does not exist in job-table, then give an error */
-    if(jobsPtr==NULL){
-        if(argv[1][0]=='%'){
-            printf("%s: No such job\n",argv[1]);
-            return;
-        }
-        else{
-            printf("(%d): No such process\n",num);
-            return;
-        }
-    }
-
-
-    /* If the job is in ST (Stopped) state */
-
-    if(jobsPtr->state == ST){
-        //if the command is "bg", then resume it in background
-        if(strcmp(argv[0],"bg")==0){
-            jobsPtr->state = BG;    //changing state from ST to BG
-            printf("[%d] (%d) %s",jobsPtr->jid,jobsPtr->pid,jobsPtr->cmdline); //print information about job resumed
-            kill(-num,SIGCONT);     //sends the SIGCONT signal to the process group of that job to resume it
-        }
-
-        //if the command is "fg", then resume the job in foreground
-        if(strcmp(argv[0],"fg")==0){
-            jobsPtr->state = FG;    //changing state from ST to FG
-            kill(-num,SIGCONT);     //sends the SIGCONT signal to the process group of that job to resume it
-            waitfg(jobsPtr->pid);   //wait for the process to terminate, since it is foreground job
-        }
-    }
-
-
-    /* If the job is not in stop state and the command is "bg", then nothing needs to be done, just print information about it */
-
-    else if(strcmp(argv[0],"bg")==0){
-        printf("[%d] (%d) %s",jobsPtr->jid,jobsPtr->pid,jobsPtr->cmdline);
-    }
-
-
-    /* If the command is "fg" and the process is running in background, then move it to foreground */
-
-    else if(jobsPtr->state == BG && strcmp(argv[0],"fg")==0){
-        jobsPtr->state = FG;    //change the state from BG to FG
-        waitfg(jobsPtr->pid);   //wait for the process to terminate
-    }
-
-    return;
-}
-
-/* 
- * waitfg - Block until process pid is no longer the foreground process
- */
-void waitfg(pid_t pid)
-{
-    struct job_t *jobsPtr;
-    jobsPtr = getjobpid(jobs,pid);  //to get the job entry corresponding to given PID
-
-    while(jobsPtr!=NULL && jobsPtr->state == FG){   //If such a job exists and running in foreground
-        sleep(1);  //Sleep for 1 second, then check if it is still running in foreground. If so, wait another second and so on.
-    }
-
-    return;
-}
-
-/*****************
- * Signal handlers
- *****************/
-
-/* 
- * sigchld_handler - The kernel sends a SIGCHLD to the shell whenever
- *     a child job terminates (becomes a zombie), or stops because it
- *     received a SIGSTOP or SIGTSTP signal. The handler reaps all
- *     available zombie children, but doesn't wait for any other
- *     currently running children to terminate.  
- */
-void sigchld_handler(int sig) 
-{
-    int status=-1;
-    pid_t pid;
-    struct job_t *jobsPtr;
-    //Checking for any process which is terminated
-    while((pid = waitpid(-1,&status,WNOHANG|WUNTRACED))>0){
-        jobsPtr = getjobpid(jobs,pid);  //geting the job containing that pid
-
-        //if it exited (Terminated normally), then delete the corresponding job-table entry.
-        if(WIFEXITED(status)){
-            deletejob(jobs,pid);  
-        }
-
-        //If it terminated due to signal, then print which signal terminated it and then remove its job-table entry.
-        if(WIFSIGNALED(status)){
-            printf("Job [%d] (%d) terminated by signal %d\n",jobsPtr->jid,jobsPtr->pid,WTERMSIG(status));
-            deletejob(jobs,pid);    
-        }
-
-        //If is stopped by the signal, then print which signal stopped it and change its state to ST, do not delete it.
-        if(WIFSTOPPED(status)){
-            printf("Job [%d] (%d) stopped by signal %d\n",jobsPtr->jid,jobsPtr->pid,WSTOPSIG(status));
-            jobsPtr->state = ST;
-        }
-    }
-    return;
-}
-
-/* 
- * sigint_handler - The kernel sends a SIGINT to the shell whenver the
- *    user types ctrl-c at the keyboard.  Catch it and send it along
- *    to the foreground job.  
- */
-void sigint_handler(int sig) 
-{
-    pid_t fjob = fgpid(jobs);
-
-    //Check if any job is running in forground
-    if(fjob!=0){
-        kill(-fjob,SIGINT); //If so then send SIGINT signal to the process group of that job
-    }
-
-    return;
-}
-
-/*
- * sigtstp_handler - The kernel sends a SIGTSTP to the shell whenever
- *     the user types ctrl-z at the keyboard. Catch it and suspend the
- *     foreground job by sending it a SIGTSTP.  
- */
-void sigtstp_handler(int sig) 
-{
-    pid_t fjob = fgpid(jobs);
-
-    //Check if any job is running in forground
-    if(fjob!=0){
-        kill(-fjob,SIGTSTP); //If so then send SIGTSTP signal to the process group of that job
-    }
-
-    return;
-}
-
-/*********************
- * End signal handlers
- *********************/
-
-/***********************************************
- * Helper routines that manipulate the job list
- **********************************************/
-
-/* clearjob - Clear the entries in a job struct */
-void clearjob(struct job_t *job) {
-    job->pid = 0;
-    job->jid = 0;
-    job->state = UNDEF;
-    job->cmdline[0] = '\0';
-}
-
-/* initjobs - Initialize the job list */
-void initjobs(struct job_t *jobs) {
-    int i;
-
-    for (i = 0; i < MAXJOBS; i++)
-	clearjob(&jobs[i]);
-}
-
-/* maxjid - Returns largest allocated job ID */
-int maxjid(struct job_t *jobs) 
-{
-    int i, max=0;
-
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].jid > max)
-	    max = jobs[i].jid;
-    return max;
-}
-
-/* addjob - Add a job to the job list */
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline) 
-{
-    int i;
-    
-    if (pid < 1)
-	return 0;
-
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid == 0) {
-	    jobs[i].pid = pid;
-	    jobs[i].state = state;
-	    jobs[i].jid = nextjid++;
-	    if (nextjid > MAXJOBS)
-		nextjid = 1;
-	    strcpy(jobs[i].cmdline, cmdline);
-  	    if(verbose){
-	        printf("Added job [%d] %d %s\n", jobs[i].jid, jobs[i].pid, jobs[i].cmdline);
-            }
-            return 1;
-	}
-    }
-    printf("Tried to create too many jobs\n");
-    return 0;
-}
-
-/* deletejob - Delete a job whose PID=pid from the job list */
-int deletejob(struct job_t *jobs, pid_t pid) 
-{
-    int i;
-
-    if (pid < 1)
-	return 0;
-
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid == pid) {
-	    clearjob(&jobs[i]);
-	    nextjid = maxjid(jobs)+1;
-	    return 1;
-	}
-    }
-    return 0;
-}
-
-/* fgpid - Return PID of current foreground job, 0 if no such job */
-pid_t fgpid(struct job_t *jobs) {
-    int i;
-
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].state == FG)
-	    return jobs[i].pid;
-    return 0;
-}
-
-/* getjobpid  - Find a job (by PID) on the job list */
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid) {
-    int i;
-
-    if (pid < 1)
-	return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].pid == pid)
-	    return &jobs[i];
-    return NULL;
-}
-
-/* getjobjid  - Find a job (by JID) on the job list */
-struct job_t *getjobjid(struct job_t *jobs, int jid) 
-{
-    int i;
-
-    if (jid < 1)
-	return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].jid == jid)
-	    return &jobs[i];
-    return NULL;
-}
-
-/* pid2jid - Map process ID to job ID */
-int pid2jid(pid_t pid) 
-{
-    int i;
-
-    if (pid < 1)
-	return 0;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].pid == pid) {
-            return jobs[i].jid;
-        }
-    return 0;
-}
-
-/* listjobs - Print the job list */
-void listjobs(struct job_t *jobs) 
-{
-    int i;
-    
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid != 0) {
-	    printf("[%d] (%d) ", jobs[i].jid, jobs[i].pid);
-	    switch (jobs[i].state) {
-		case BG: 
-		    printf("Running ");
-		    break;
-		case FG: 
-		    printf("Foreground ");
-		    break;
-		case ST: 
-		    printf("Stopped ");
-		    break;
-	    default:
-		    printf("listjobs: Internal error: job[%d].state=%d ", 
-			   i, jobs[i].state);
-	    }
-	    printf("%s", jobs[i].cmdline);
-	}
-    }
-}
-/******************************
- * end job list helper routines
- ******************************/
-
-
-/***********************
- * Other helper routines
- ***********************/
-
-/*
- * usage - print a help message
- */
-void usage(void) 
-{
-    printf("Usage: shell [-hvp]\n");
-    printf("   -h   print this message\n");
-    printf("   -v   print additional diagnostic information\n");
-    printf("   -p   do not emit a command prompt\n");
-    exit(1);
-}
-
-/*
- * unix_error - unix-style error routine
- */
-void unix_error(char *msg)
-{
-    fprintf(stdout, "%s: %s\n", msg, strerror(errno));
-    exit(1);
-}
-
-/*
- * app_error - application-style error routine
- */
-void app_error(char *msg)
-{
-    fprintf(stdout, "%s\n", msg);
-    exit(1);
-}
-
-/*
- * Signal - wrapper for the sigaction function
- */
-handler_t *Signal(int signum, handler_t *handler) 
-{
-    struct sigaction action, old_action;
-
-    action.sa_handler = handler;  
-    sigemptyset(&action.sa_mask); /* block sigs of type being handled */
-    action.sa_flags = SA_RESTART; /* restart syscalls if possible */
-
-    if (sigaction(signum, &action, &old_action) < 0)
-	unix_error("Signal error");
-    return (old_action.sa_handler);
-}
-
-/*
- * sigquit_handler - The driver program can gracefully terminate the
- *    child shell by sending it a SIGQUIT signal.
- */
-void sigquit_handler(int sig) 
-{
-    printf("Terminating after receipt of SIGQUIT signal\n");
-    exit(1);
-}
-
-
-
+/* 
+ * tsh - A tiny shell program with job control
+ * 
+ * Name: Meet Pravinbhai Sinojia
+ * ID: 201601126
+ * Email: 201601126@daiict.ac.in
+ */
+
+#define _GNU_SOURCE   /* pipe2, F_SETPIPE_SZ, splice, cpu_set_t */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdarg.h>
+#include <sched.h>
+#include <termios.h>
+#include <time.h>
+#include <dirent.h>
+
+/* Misc manifest constants */
+#define MAXLINE    1024   /* size of message buffers */
+#define JOBHASH0     16   /* initial number of job hash buckets */
+#define ENDJOBS      64   /* ended background jobs whose status wait can still report */
+#define MAXJID    1<<16   /* max job ID */
+#define MAXEVENTS    64   /* max events handled per epoll_wait */
+#define CHLDRING    256   /* child state changes queued per reaping pass, a power of 2 */
+#define INBUFSZ (1<<16)   /* initial size of the input read buffer */
+#define OUTBUFSZ (1<<16)  /* stdout buffer size in script mode */
+#define ARENACHUNK (1<<16) /* minimum size of a command arena chunk */
+#define PIPESZ  (1<<20)   /* requested capacity of pipeline pipes */
+#define COPYCHUNK (1<<20) /* max bytes the cat builtin copies between checks for events */
+#define PATHHASH    256   /* number of PATH lookup cache buckets */
+#define MAXNODE    1024   /* NUMA nodes a job can be bound to */
+#define ESBUFSZ (1<<20)   /* events buffered for a slow event stream reader */
+#define DENTBUFSZ (1<<18) /* bytes of directory entries read per getdents64 call */
+#define DIRCACHE     16   /* directory listings kept for pathname expansion */
+#define DIRCACHETTL   5   /* seconds a cached listing may be used for */
+#define CAPCHUNK (1<<16)  /* max bytes of captured output read or shown at once */
+#define TREECACHE    64   /* compiled command lines kept */
+#define TREEHASH    128   /* number of compiled command line hash buckets */
+#define LOOPPOLL    256   /* loop iterations between checks for signals and children */
+#define PHBUCKETS    40   /* latency histogram buckets, bucket i counting [2^(i-1), 2^i) ns */
+#define CLIENTBUF (1<<20) /* most bytes a job server client may have waiting to be run */
+#define FDRESERVE    64   /* descriptors never taken by pidfds, for pipes, files and clients */
+
+/* Job states */
+#define UNDEF 0 /* undefined */
+#define FG 1    /* running in foreground */
+#define BG 2    /* running in background */
+#define ST 3    /* stopped */
+#define QU 4    /* queued, not started yet */
+
+/* Elements of a compiled glob pattern (struct gtok_t) */
+#define GT_CHAR 0 /* a given character */
+#define GT_ANY  1 /* ? */
+#define GT_STAR 2 /* * */
+#define GT_SET  3 /* [...] */
+
+/* Commands of a compiled command line (struct node_t) */
+#define N_CMD    0 /* a pipeline */
+#define N_REPEAT 1 /* repeat N ... */
+#define N_FOR    2 /* for x in ...; do ...; done */
+
+/* When a command of a list runs, after the one before it */
+#define C_SEQ 0 /* always: ; or & */
+#define C_AND 1 /* if it succeeded: && */
+#define C_OR  2 /* if it failed: || */
+
+/* What a word has that depends on when it is expanded (struct ctparse_t) */
+#define W_GLOB 1 /* wildcards */
+#define W_VAR  2 /* variables */
+
+/* What a job placement sets (struct place_t) */
+#define PL_CPUS 1 /* CPU affinity */
+#define PL_NICE 2 /* nice value */
+#define PL_IO   4 /* I/O scheduling class and level */
+#define PL_NODE 8 /* NUMA node for memory */
+
+/* Automatic placement of background jobs */
+#define SP_OFF   0 /* none */
+#define SP_CORES 1 /* each on the next CPU */
+#define SP_NODES 2 /* each on the next NUMA node */
+
+/* Not in the C library headers */
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define MPOL_BIND 2
+#ifndef PIDFD_SIGNAL_PROCESS_GROUP
+#define PIDFD_SIGNAL_PROCESS_GROUP (1 << 2)  /* Linux 6.9 */
+#endif
+
+/* 
+ * Jobs states: FG (foreground), BG (background), ST (stopped),
+ *     QU (queued, not started yet)
+ * Job state transitions and enabling actions:
+ *     FG -> ST  : ctrl-z
+ *     ST -> FG  : fg command
+ *     ST -> BG  : bg command
+ *     BG -> FG  : fg command
+ *     QU -> BG  : qadmit() once the queue's limits allow it, or bg command
+ *     QU -> FG  : fg command, whatever the limits
+ * kill drops a QU job from the list without starting it, so no event
+ * is reported for it. startjob() makes both QU transitions.
+ * At most 1 job can be in the FG state.
+ */
+
+/* Global variables */
+extern char **environ;      /* defined in libc */
+char prompt[] = "tsh> ";    /* command line prompt (DO NOT CHANGE) */
+int verbose = 0;            /* if true, print additional output */
+int usefork = 0;            /* if true, launch jobs with fork() instead of vfork() */
+char sbuf[MAXLINE];         /* for composing sprintf messages */
+
+/* Operators, as stored in argv by parseline. They are recognized by
+ * address rather than by contents, so that a quoted "|" is a plain word. */
+enum { OPIPE, OIN, OOUT, OAPPEND, ODUP, OBG, OSEMI, OAND, OOR, NOPS };
+char optab[NOPS][5] = { "|", "<", ">", ">>", "2>&1", "&", ";", "&&", "||" };
+#define isop(s) ((s) >= optab[0] && (s) < optab[NOPS])
+
+struct proc_t {             /* A process of a job (one pipeline stage) */
+    pid_t pid;              /* its PID */
+    int done;               /* true once it has been reaped */
+    int status;             /* wait status, valid once done */
+    int pidfd;              /* refers to it for as long as it runs, -1 if none */
+    struct job_t *job;      /* the job it belongs to */
+    struct proc_t *next;    /* next process of the same job */
+    struct proc_t *pidnext; /* next process in the same PID hash bucket */
+};
+
+struct place_t {            /* Where and how the processes of a job run */
+    int set;                /* which of the following apply, PL_* */
+    cpu_set_t cpus;         /* CPUs they may run on */
+    int nice;               /* their nice value */
+    int ioprio;             /* their I/O class and level, as for ioprio_set() */
+    int node;               /* NUMA node their memory is bound to */
+};
+
+struct job_t {              /* The job struct */
+    pid_t pid;              /* job PID, also the job's process group ID */
+    int jid;                /* job ID [1, 2, ...] */
+    int state;              /* UNDEF, BG, FG, or ST */
+    char *cmdline;          /* command line, allocated to fit */
+    struct proc_t *procs;   /* its processes, in pipeline order */
+    int nlive;              /* number of processes not yet reaped */
+    void (*done)(struct job_t *job, int status); /* called when the job is over, or NULL */
+    void *data;             /* for the done callback */
+    struct timespec start;  /* when it was started (CLOCK_MONOTONIC) */
+    struct timespec end;    /* when its last process was reaped */
+    struct rusage ru;       /* resources used by its reaped processes */
+    struct place_t place;   /* where it was placed */
+    int prio;               /* queue priority, higher goes first */
+    unsigned seq;           /* queue order among equal priorities */
+    int qidx;               /* position in the queue heap */
+    struct outbuf_t *out;   /* its captured output (-b), or NULL */
+    struct termios tmodes;  /* its terminal modes when it last stopped, */
+    int hasmodes;           /* if it has stopped in the foreground */
+    struct job_t *jidnext;  /* next job in the same JID hash bucket */
+    struct job_t *prev;     /* previous job in JID order */
+    struct job_t *next;     /* next job in JID order */
+};
+
+struct jobtab_t {           /* The job list */
+    struct job_t *head;     /* job with the smallest JID */
+    struct job_t *tail;     /* job with the largest JID */
+    struct proc_t **pidhash; /* processes hashed by PID */
+    struct job_t **jidhash; /* jobs hashed by JID */
+    size_t nbuckets;        /* size of both hash arrays, a power of 2 */
+    size_t njobs;           /* number of jobs in the list */
+    size_t nprocs;          /* number of processes of those jobs */
+    size_t npidfds;         /* number of pidfds they hold */
+    size_t maxpidfds;       /* most they may hold, below RLIMIT_NOFILE */
+    struct job_t *fg;       /* the foreground job, NULL if none */
+    int nrunning;           /* number of jobs in the BG state */
+    struct endjob_t {       /* The last background jobs that ended unwaited for */
+        int jid;            /* its JID, 0 for a free slot */
+        pid_t pid;          /* its PID */
+        int status;         /* its exit status, as wait returns it */
+    } ended[ENDJOBS];
+    int nended;             /* slot of the next one, going round */
+};
+struct jobtab_t jobs;       /* The job list */
+
+struct redir_t {            /* An I/O redirection of a command */
+    int fd;                 /* descriptor being redirected */
+    char *path;             /* file to open, NULL to copy dupfd instead */
+    int flags;              /* open() flags for path */
+    int dupfd;              /* descriptor to copy when path is NULL */
+};
+
+struct cmd_t {              /* A parsed command line */
+    char **argv;            /* its words, after the prefixes */
+    struct stage_t *stages; /* the commands of its pipeline */
+    int nstages;            /* how many there are */
+    int bg;                 /* it ends with & */
+    int timed;              /* it was prefixed with "time" */
+    int prio;               /* queue priority, from a "queue" prefix */
+    struct place_t place;   /* placement, from a "place" prefix */
+    int pure;               /* parsing it had no side effects, so the parse can be reused */
+};
+
+struct stage_t {            /* One command of a pipeline */
+    char **argv;            /* its arguments */
+    char *path;             /* cached location of argv[0], NULL to search PATH */
+    int infd;               /* descriptor for its stdin, -1 to inherit */
+    int outfd;              /* descriptor for its stdout, -1 to inherit */
+    int errfd;              /* descriptor for its stderr, -1 to inherit */
+    struct redir_t *redirs; /* its redirections, applied in order after the pipes */
+    int nredirs;            /* number of redirections */
+    struct place_t *place;  /* placement of its process, NULL for none */
+    int tty;                /* it takes over the terminal, as part of the foreground job */
+};
+
+typedef void evhandler_t(int fd, void *arg);
+struct evsrc_t {            /* An event source watched by the event loop */
+    int fd;                 /* watched descriptor */
+    evhandler_t *fn;        /* called when fd is ready, NULL once deleted */
+    void *arg;              /* passed through to fn */
+    struct evsrc_t *next;   /* link on the deferred free list */
+};
+struct chldev_t {           /* A child state change, as reaped by sigchld_handler */
+    pid_t pid;              /* the child */
+    int status;             /* its wait status */
+    struct rusage ru;       /* resources it used, if it is gone */
+};
+struct chldev_t chldring[CHLDRING]; /* reaped but not yet processed state changes */
+unsigned chldhead = 0;      /* next slot to fill, only advanced by sigchld_handler */
+unsigned chldtail = 0;      /* next slot to process, only advanced by chld_drain */
+
+int epfd = -1;              /* epoll instance of the event loop */
+sigset_t origmask;          /* signal mask to restore in children */
+sigset_t shellmask;         /* signals read synchronously through a signalfd */
+
+struct linebuf_t {          /* Buffered reader for command lines */
+    int fd;                 /* descriptor lines are read from */
+    char *buf;              /* buffered bytes */
+    size_t cap;             /* allocated size of buf */
+    char *line;             /* last line returned, NUL-terminated */
+    size_t linecap;         /* allocated size of line */
+    size_t start, end;      /* unconsumed bytes are buf[start..end) */
+    int eof;                /* read() has returned 0 */
+    struct evsrc_t *src;    /* epoll registration, NULL if fd is not pollable */
+    int ready;              /* set by the event loop when fd is readable */
+};
+struct linebuf_t input;     /* the shell's command input */
+
+struct chunk_t {            /* A block of the command arena */
+    struct chunk_t *next;   /* next (older) block */
+    size_t used, cap;       /* bytes handed out and available in data */
+    char data[];
+};
+struct chunk_t *arena;      /* per-command allocations, freed after each eval() */
+struct amark_t {            /* A point in the command arena to go back to */
+    struct chunk_t *chunk;  /* the newest block then */
+    size_t used;            /* and how much of it was used */
+};
+
+struct node_t {             /* A command of a compiled command line */
+    int type;               /* N_CMD, N_REPEAT or N_FOR */
+    int conn;               /* when it runs after the one before it, C_* */
+    struct node_t *next;    /* the next command of the same list */
+    char *text;             /* N_CMD: its command line, N_FOR: its words, as typed */
+    int bg;                 /* N_CMD: it ends with & */
+    int dynamic;            /* N_CMD: it has patterns or variables, so it is parsed each time */
+    struct cmd_t *cmd;      /* N_CMD: its parse, once it has been run, if not dynamic */
+    long count;             /* N_REPEAT: how many times */
+    char *var;              /* N_FOR: the variable */
+    struct node_t *body;    /* N_REPEAT, N_FOR: the commands repeated */
+};
+struct tree_t {             /* A compiled command line */
+    char *line;             /* its text */
+    struct node_t *nodes;   /* its list of commands */
+    int pins;               /* evaluations in progress */
+    int evicted;            /* it is no longer cached, free it once unpinned */
+    struct tree_t *hnext;   /* next in the same hash bucket */
+    struct tree_t *prev, *next; /* in the LRU list, most recently used first */
+};
+struct tree_t *treehash[TREEHASH]; /* compiled command lines, by their text */
+struct tree_t *treelru = NULL;     /* most recently used */
+struct tree_t *treeold = NULL;     /* least recently used */
+int ntrees = 0;
+struct ctparse_t {          /* A command line being compiled */
+    char *p;                /* where the next token starts */
+    char *tok;              /* the current one: an operator in optab, a word, or NULL at the end */
+    size_t len;             /* length of a word */
+    int flags;              /* what a word has, W_* */
+    int err;                /* a syntax error was reported */
+    int nsep;               /* how many ; & && and || were read */
+};
+struct var_t {              /* A loop variable, bound while its loop runs */
+    char *name;
+    char *value;
+    struct var_t *next;     /* enclosing loop's */
+};
+struct var_t *loopvars = NULL; /* innermost first */
+
+/* Phases of command handling that are timed for the stats builtin */
+enum { PH_READ, PH_PARSE, PH_BUILTIN, PH_SPAWN, PH_EXEC, PH_WAKE, PH_SIGCHLD,
+       PH_ADDJOB, PH_DELJOB, PH_LOOKUP, NPHASES };
+struct phase_t {            /* Timings of a phase since the last reset */
+    char *name;
+    char *what;             /* what is timed, for stats -v */
+    unsigned long n;        /* how many times it was timed */
+    unsigned long long sum; /* total nanoseconds */
+    unsigned long long max; /* longest */
+    unsigned long hist[PHBUCKETS]; /* counts by log2 of the nanoseconds */
+};
+struct phase_t phases[NPHASES] = {
+    { "read",      "reading a command line, not waiting for it" },
+    { "parse",     "parseline(): splitting a command into words" },
+    { "builtin",   "finding and running a builtin command" },
+    { "spawn",     "launching the processes of a pipeline" },
+    { "exec",      "from vfork() to the child's exec" },
+    { "wakeup",    "from SIGCHLD to waitfg() returning" },
+    { "sigchld",   "reaping children and updating the job list" },
+    { "addjob",    "adding a job" },
+    { "deletejob", "deleting a job" },
+    { "lookup",    "finding a job or process by JID or PID" },
+};
+long long chldat = 0;       /* when the last SIGCHLD was read */
+pid_t statspid = 0;         /* with -S, the shell whose statistics are printed at exit */
+
+struct pathent_t {          /* A PATH lookup cache entry */
+    char *name;             /* command name */
+    char *path;             /* where it was found in PATH */
+    struct pathent_t *next; /* next entry in the same bucket */
+};
+struct prun_t {             /* A run of the parallel builtin */
+    char **cmd;             /* command template, {} stands for the item */
+    int running;            /* items in flight */
+    int nitems;             /* items started */
+    int failed;             /* items that didn't exit with status 0 */
+    int stop;               /* ctrl-c or ctrl-z: start no more items */
+};
+struct prun_t *prun = NULL; /* the parallel run in progress, if any */
+
+struct pathent_t *pathhash[PATHHASH]; /* PATH lookup cache, by command name */
+char *pathcached;           /* value of PATH the cache was filled from */
+
+struct dirlist_t {          /* The entries of a directory, for pathname expansion */
+    dev_t dev;              /* which directory */
+    ino_t ino;
+    struct timespec mtime;  /* its modification time when it was read */
+    time_t when;            /* when it was read (CLOCK_MONOTONIC seconds) */
+    int racy;               /* it could have changed within the same mtime */
+    char **names;           /* its entries, sorted, each preceded by its d_type */
+    int nnames;             /* how many there are */
+    char *data;             /* where they are stored */
+    int pins;               /* expansions in progress using it */
+    int evicted;            /* no longer in the cache, free it once unpinned */
+};
+struct dent64_t {            /* A directory entry, as returned by getdents64() */
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+struct dirlist_t *dircache[DIRCACHE]; /* recently read directories, NULL slots are free */
+char *dentbuf;              /* getdents64 buffer, DENTBUFSZ bytes */
+
+struct gtok_t {             /* An element of a compiled glob pattern */
+    int op;                 /* GT_* */
+    int c;                  /* the character, for GT_CHAR */
+    unsigned char *set;     /* the characters it matches (a 256 bit map), for GT_SET */
+};
+struct globctx_t {          /* An expansion in progress */
+    char ***argvp;          /* the argv it adds the pathnames to */
+    int *argcp;             /* its length */
+    size_t *capp;           /* its allocated size */
+    size_t reserve;         /* entries to keep free for the rest of the command line */
+    int n;                  /* pathnames added so far */
+};
+
+struct builtin_t {          /* A command executed by the shell itself */
+    char *name;
+    int (*fn)(char **argv); /* runs it, returns its exit status */
+};
+struct jobsel_t {           /* A set of jobs given to kill: %N, %N-M or %state */
+    int lo, hi;             /* range of JIDs */
+    int states;             /* states they may be in, 1<<state */
+    int matched;            /* some job was in it */
+    char *arg;              /* as given */
+};
+int laststatus = 0;         /* exit status of the last foreground command */
+int spread = SP_OFF;        /* automatic placement of background jobs, SP_* */
+
+struct qlimits_t {          /* When a queued background job may start */
+    int maxrun;             /* at most this many running background jobs, 0 for no limit */
+    double maxload;         /* while the load is below this, 0 for no limit */
+    long minfree;           /* while at least this many MB are available, 0 for no limit */
+};
+struct qlimits_t qlimits;   /* limits of the background job queue, all off to never queue */
+struct job_t **queue;       /* the queued jobs, a heap by priority */
+int qlen, qcap;             /* jobs in the queue and its allocated size */
+unsigned qseq;              /* submission counter, for FIFO order */
+struct timespec qlast;      /* when the last job was let through on load or memory */
+struct evsrc_t *qtimer;     /* rechecks the limits while jobs are queued */
+
+struct estream_t {          /* The job event stream (-e) */
+    int fd;                 /* where it goes, -1 if off */
+    char buf[ESBUFSZ];      /* events not written yet */
+    size_t len;             /* bytes in buf */
+    size_t mark;            /* where the event being built starts */
+    int full;               /* it didn't fit */
+    unsigned long dropped;  /* events lost since the reader fell behind */
+    struct evsrc_t *src;    /* waiting for fd to be writable, or NULL */
+};
+struct estream_t estream = { -1 };
+
+struct outbuf_t {           /* Captured output of a background job (-b) */
+    int fd;                 /* read end of the job's output pipe, -1 at EOF */
+    struct evsrc_t *src;    /* its event loop registration */
+    char *buf;              /* the last capsize bytes, as a ring */
+    size_t total;           /* bytes captured; byte i is at buf[i % capsize] */
+    size_t printed;         /* bytes shown so far */
+    int spillfd;            /* older bytes that fell out of the ring, -1 if none */
+    size_t spilled;         /* how many of them made it to the file */
+};
+size_t capsize = 0;         /* ring size for background job output, 0 to not capture */
+
+struct client_t {           /* A connection to the job server (-s) */
+    int fd;                 /* its socket */
+    struct evsrc_t *src;    /* watching it for input, NULL once it has shut down */
+    char *buf;              /* bytes received but not yet run */
+    size_t len, cap;        /* how many there are, and the allocated size of buf */
+    int eof;                /* it has shut down its end, or asked to quit */
+    int waiting;            /* its wait builtin hasn't been answered yet */
+    int *waitjids;          /* the jobs it waits for, all background jobs if nwait is 0 */
+    int nwait;              /* how many there are */
+    int status;             /* the status to answer the wait with */
+    struct client_t *next;  /* next connection */
+};
+struct client_t *clients = NULL; /* the job server's connections */
+struct client_t *client = NULL;  /* the one whose command is being run, NULL for our own input */
+int srvfd = -1;             /* the job server's listening socket, -1 if not serving */
+char *srvpath;              /* where it is bound */
+int srvout = -1;            /* our own stdout while a client's command runs, for its jobs */
+int busy = 0;               /* a command line is being evaluated */
+int interactive = 0;        /* foreground jobs get the terminal (prompting, on a tty) */
+pid_t shellpgid;            /* our own process group, that has the terminal otherwise */
+struct termios shellmodes;  /* our terminal modes, restored after each foreground job */
+
+struct zreq_t {             /* A launch request to the zygote, followed by its data */
+    int join;               /* join the group of the last leader it started, else lead one */
+    int hasin, hasout, haserr; /* a stdin, stdout, stderr descriptor comes with it (after the cwd) */
+    int nargs;              /* words of argv */
+    int nenv;               /* entries of the environment */
+    int nredirs;            /* redirections */
+    int hasplace;           /* place applies */
+    int tty;                /* as in struct stage_t */
+    struct place_t place;   /* the job's placement */
+    size_t len;             /* bytes of data: the redirections, then the strings */
+};
+struct zredir_t {           /* A redirection, as sent to the zygote */
+    int fd, flags, dupfd;   /* as in struct redir_t */
+    int haspath;            /* its path is among the strings */
+};
+struct zreply_t {           /* The zygote's answer, followed by whatlen bytes */
+    pid_t pid;              /* the new process, -1 if it couldn't be created */
+    int err;                /* errno if it failed to start, else 0 */
+    int stale;              /* the cached path of argv[0] is gone */
+    int whatlen;            /* length of the file a redirection failed on, 0 if exec failed */
+};
+struct zpend_t {            /* A process the zygote started and hasn't answered for yet */
+    struct zreply_t rep;    /* the answer */
+    char *what;             /* its whatlen bytes */
+    int errfd;              /* the process's report pipe, -1 once it has exec'd or failed */
+};
+int zygote = -1;           /* socket to the zygote process (-z), -1 if not in use */
+unsigned spreadnext = 0;    /* where the next one goes */
+int waiting = 0;            /* the wait builtin is blocked, until ctrl-c */
+int interrupted = 0;        /* ctrl-c was typed, which ends the loops of the command line */
+/* End global variables */
+
+
+/* Function prototypes */
+
+/* Here are the functions that you will implement */
+void eval(char *cmdline);
+void execcmd(struct cmd_t *cmd, char *cmdline);
+int parsecmd(char *cmdline, struct cmd_t *cmd);
+struct job_t *runcmd(struct cmd_t *cmd, char *cmdline, struct job_t *job);
+int builtin_cmd(char **argv);
+int isbuiltin(char **argv);
+struct builtin_t *findbuiltin(const char *name);
+int do_quit(char **argv);
+int do_jobs(char **argv);
+int do_bgfg(char **argv);
+int do_cat(char **argv);
+int do_hash(char **argv);
+int do_parallel(char **argv);
+int do_echo(char **argv);
+int do_printf(char **argv);
+int do_cd(char **argv);
+int do_pwd(char **argv);
+int do_test(char **argv);
+int do_export(char **argv);
+int do_unset(char **argv);
+int do_kill(char **argv);
+int do_wait(char **argv);
+int do_true(char **argv);
+int do_output(char **argv);
+int do_false(char **argv);
+int do_stats(char **argv);
+void printtimes(double real, struct rusage *ru);
+void time_done(struct job_t *job, int status);
+void waitfg(pid_t pid);
+void prun_signal(int sig);
+int parsepipe(char **argv, struct stage_t *stages, struct redir_t *redirs);
+int redirect(struct stage_t *stage, char **what);
+int launch(struct stage_t *stages, int nstages, pid_t *pids, int capfd);
+pid_t spawn(struct stage_t *stage, pid_t pgid);
+
+void sigchld_handler(int sig);
+void chld_drain(void);
+void sigtstp_handler(int sig);
+void sigint_handler(int sig);
+
+/* Event loop routines */
+void ev_init(void);
+struct evsrc_t *ev_add(int fd, int events, evhandler_t *fn, void *arg);
+void ev_del(struct evsrc_t *src);
+struct evsrc_t *ev_timer(long ms, int periodic, evhandler_t *fn, void *arg);
+void ev_wait(int timeout);
+void sigfd_ready(int fd, void *arg);
+void lb_init(struct linebuf_t *lb, int fd);
+void lb_free(struct linebuf_t *lb);
+char *lb_getline(struct linebuf_t *lb);
+
+/* PATH lookup cache routines */
+unsigned long strhash(const char *str);
+char *hashfind(const char *name);
+void hashdrop(const char *name);
+void hashclear(void);
+
+/* Pathname expansion routines */
+char *globpat(const char *src, size_t len);
+int globexpand(char *pat, struct globctx_t *ctx);
+
+/* Command tree routines */
+struct tree_t *ct_find(char *line);
+void ct_release(struct tree_t *t);
+void ct_run(struct node_t *n);
+
+/* Job placement routines */
+int parseplace(char ***argvp, struct place_t *pl);
+void autoplace(struct place_t *pl);
+int applyplace(struct place_t *pl);
+void printplace(struct place_t *pl);
+
+/* Background job queue routines */
+int parsequeue(char ***argvp, int *prio);
+int qactive(void);
+void qpush(struct job_t *job);
+void qremove(struct job_t *job);
+void qadmit(void);
+int startjob(struct job_t *job, int state);
+
+/* Event stream routines */
+void es_open(int fd);
+void es_begin(const char *event, struct job_t *job);
+void es_printf(const char *fmt, ...);
+void es_string(const char *name, const char *str);
+void es_end(void);
+
+/* Output capture routines */
+struct outbuf_t *ob_open(int *wfd);
+void ob_read(struct outbuf_t *ob);
+void ob_show(struct outbuf_t *ob, size_t from);
+void ob_close(struct outbuf_t *ob);
+
+/* Job server routines */
+void srv_open(char *path);
+void srv_run(void);
+int srv_allowed(char **argv);
+int srv_wait(char **argv);
+int srv_client(char *path, char **words);
+
+/* Terminal routines */
+void tty_init(void);
+void tty_give(struct job_t *job);
+void tty_take(struct job_t *job);
+
+/* Zygote routines */
+void zinit(void);
+int zsend(struct stage_t *stage, int join);
+pid_t zrecv(struct stage_t *stage);
+
+/* Statistics routines */
+long long ph_now(void);
+void ph_add(int ph, long long ns);
+void ph_print(int verbose);
+void ph_reset(void);
+void ph_exit(void);
+
+/* Command arena routines */
+void *arena_alloc(size_t size);
+void arena_reset(void);
+void arena_mark(struct amark_t *m);
+void arena_release(struct amark_t *m);
+
+/* Here are helper routines that we've provided for you */
+int parseline(const char *cmdline, char ***argvp); 
+char *lexop(char **bufp);
+void sigquit_handler(int sig);
+
+void clearjob(struct job_t *job);
+void initjobs(struct jobtab_t *jobs);
+int maxjid(struct jobtab_t *jobs); 
+int addjob(struct jobtab_t *jobs, pid_t pid, int state, char *cmdline);
+int addproc(struct jobtab_t *jobs, struct job_t *job, pid_t pid);
+void closepidfd(struct jobtab_t *jobs, struct proc_t *p);
+void addended(struct jobtab_t *jobs, struct job_t *job, int status);
+int takeended(struct jobtab_t *jobs, int jid, pid_t pid);
+int deletejob(struct jobtab_t *jobs, pid_t pid); 
+void removejob(struct jobtab_t *jobs, struct job_t *job);
+void setjobstate(struct jobtab_t *jobs, struct job_t *job, int state);
+pid_t fgpid(struct jobtab_t *jobs);
+int signaljob(struct job_t *job, int sig);
+int signalproc(pid_t pid, int sig);
+struct proc_t *getproc(struct jobtab_t *jobs, pid_t pid);
+struct job_t *getjobpid(struct jobtab_t *jobs, pid_t pid);
+struct job_t *getjobjid(struct jobtab_t *jobs, int jid); 
+int pid2jid(pid_t pid); 
+void listjobs(struct jobtab_t *jobs);
+void printjob(struct job_t *job, int lflag);
+
+void usage(void);
+void unix_error(char *msg);
+void app_error(char *msg);
+typedef void handler_t(int);
+handler_t *Signal(int signum, handler_t *handler);
+
+/* The builtin commands, sorted by name for findbuiltin() */
+struct builtin_t builtins[] = {
+    { "[",        do_test },
+    { "bg",       do_bgfg },
+    { "cat",      do_cat },
+    { "cd",       do_cd },
+    { "echo",     do_echo },
+    { "export",   do_export },
+    { "false",    do_false },
+    { "fg",       do_bgfg },
+    { "hash",     do_hash },
+    { "jobs",     do_jobs },
+    { "kill",     do_kill },
+    { "output",   do_output },
+    { "parallel", do_parallel },
+    { "printf",   do_printf },
+    { "pwd",      do_pwd },
+    { "quit",     do_quit },
+    { "stats",    do_stats },
+    { "test",     do_test },
+    { "true",     do_true },
+    { "unset",    do_unset },
+    { "wait",     do_wait },
+};
+#define NBUILTINS (sizeof(builtins)/sizeof(builtins[0]))
+
+/*
+ * main - The shell's main routine 
+ */
+int main(int argc, char **argv) 
+{
+    char c;
+    char *cmdline;
+    char *script = NULL; /* script to run instead of reading stdin */
+    int infd = STDIN_FILENO;
+    int emit_prompt = 1; /* emit prompt (default) */
+    int evfd = -1;       /* descriptor for the job event stream */
+    int usezygote = 0;   /* launch through a zygote */
+    char *end;
+    char *srv = NULL;    /* serve jobs on this socket */
+    char *connect = NULL; /* or submit commands to the server on this one */
+
+    /* Redirect stderr to stdout (so that driver will get all output
+     * on the pipe connected to stdout) */
+    dup2(1, 2);
+
+    /* Parse the command line */
+    while ((c = getopt(argc, argv, "+hvpFzSf:e:b:s:C:")) != EOF) {
+        switch (c) {
+        case 'h':             /* print help message */
+            usage();
+	    break;
+        case 'v':             /* emit additional diagnostic info */
+            verbose = 1;
+	    break;
+        case 'p':             /* don't print a prompt */
+            emit_prompt = 0;  /* handy for automatic testing */
+	    break;
+        case 'F':             /* launch jobs with plain fork() */
+            usefork = 1;
+	    break;
+        case 'z':             /* launch jobs through a zygote process */
+            usezygote = 1;
+	    break;
+        case 'S':             /* print the statistics at exit */
+            statspid = getpid();
+            atexit(ph_exit);
+	    break;
+        case 'f':             /* run a script file */
+            script = optarg;
+            emit_prompt = 0;
+	    break;
+        case 'e':             /* write job events to a descriptor */
+            evfd = atoi(optarg);
+            if (fcntl(evfd, F_GETFL) < 0) {
+                printf("-e %s: %s\n", optarg, strerror(errno));
+                exit(1);
+            }
+	    break;
+        case 'b':             /* capture background job output */
+            capsize = strtoul(optarg, &end, 10);
+            if (*end == 'k' || *end == 'K')
+                capsize <<= 10, end++;
+            else if (*end == 'm' || *end == 'M')
+                capsize <<= 20, end++;
+            if (*end != '\0' || capsize == 0) {
+                printf("-b %s: Invalid size\n", optarg);
+                exit(1);
+            }
+	    break;
+        case 's':             /* serve jobs on a UNIX socket */
+            srv = optarg;
+	    break;
+        case 'C':             /* submit commands to such a server */
+            connect = optarg;
+	    break;
+	default:
+            usage();
+	}
+    }
+
+    /* As a client, there is no shell to set up */
+    if (connect != NULL)
+	exit(srv_client(connect, argv + optind));
+
+    /* The zygote is forked first, while the shell is at its smallest
+     * and its signal handling is still the default */
+    if (usezygote)
+	zinit();
+
+    /* This one provides a clean way to kill the shell */
+    Signal(SIGQUIT, sigquit_handler); 
+
+    /* ctrl-c, ctrl-z and child state changes are read from a signalfd
+     * by the event loop and handled synchronously */
+    ev_init();
+    if (evfd >= 0)
+	es_open(evfd);
+    if (srv != NULL)
+	srv_open(srv);
+    if (emit_prompt && isatty(STDIN_FILENO))
+	tty_init();
+
+    /* In script mode, our own output is flushed only when a child is
+     * about to write to the same place or we are about to block */
+    if (script != NULL) {
+	if ((infd = open(script, O_RDONLY | O_CLOEXEC)) < 0)
+	    unix_error(script);
+	setvbuf(stdout, NULL, _IOFBF, OUTBUFSZ);
+    }
+
+    /* Initialize the job list */
+    initjobs(&jobs);
+    lb_init(&input, infd);
+
+    /* Execute the shell's read/eval loop */
+    while (1) {
+
+	/* Read command line */
+	if (emit_prompt) {
+	    printf("%s", prompt);
+	    fflush(stdout);
+	}
+	if ((cmdline = lb_getline(&input)) == NULL) { /* End of file (ctrl-d) */
+	    fflush(stdout);
+	    while (srvfd >= 0)  /* a server goes on serving its clients */
+		ev_wait(-1);
+	    exit(0);
+	}
+
+	/* Evaluate the command line, then whatever clients sent meanwhile */
+	busy = 1;
+	eval(cmdline);
+	arena_reset();
+	busy = 0;
+	srv_run();
+    } 
+
+    exit(0); /* control never reaches here */
+}
+  
+/* 
+ * eval - Evaluate the command line that the user has just typed in
+ *
+ * A command line is a list of commands separated by ; & && or ||,
+ * where each is a pipeline, "repeat N command", "repeat N do list;
+ * done" or "for x in words; do list; done". It is compiled into a
+ * command tree once, and the most recently used trees are cached by
+ * their text, so a line that comes again (or a loop body) isn't
+ * tokenized and parsed again.
+ */
+void eval(char *cmdline)
+{
+    struct tree_t *t;
+
+    interrupted = 0;
+    if((t=ct_find(cmdline))==NULL){  //It can't be compiled, error was already printed
+        laststatus = 2;
+        return;
+    }
+    ct_run(t->nodes);
+    ct_release(t);
+}
+
+/* 
+ * execcmd - Execute one parsed command of a command line
+ * 
+ * If the user has requested a built-in command (quit, jobs, bg or fg)
+ * then execute it immediately. Otherwise, fork a child process and
+ * run the job in the context of the child. If the job is running in
+ * the foreground, wait for it to terminate and then return.  Note:
+ * each child process must have a unique process group ID so that our
+ * background children don't receive SIGINT (SIGTSTP) from the kernel
+ * when we type ctrl-c (ctrl-z) at the keyboard.  
+*/
+void execcmd(struct cmd_t *cmd, char *cmdline) 
+{
+    int saved[3];  //The shell's own stdin, stdout and stderr while a builtin is redirected
+    char *what;
+    int i;
+    struct timespec t0, t1;
+    struct rusage self0, child0, self1, child1;
+    struct job_t *job;
+
+    /*
+     * If user entered a built-in command, then function builtin_cmd() executes the command right here.
+     * A redirected builtin runs inside the shell, so the redirections are applied to the shell's own
+     * descriptors for the duration of the command and undone afterwards.
+     */
+    if(cmd->nstages==1 && isbuiltin(cmd->argv)){
+        if(cmd->timed){
+            clock_gettime(CLOCK_MONOTONIC,&t0);
+            getrusage(RUSAGE_SELF,&self0);
+            getrusage(RUSAGE_CHILDREN,&child0);
+        }
+        if(cmd->stages[0].nredirs>0){
+            fflush(stdout);
+            for(i=0;i<3;i++){
+                saved[i] = fcntl(i,F_DUPFD_CLOEXEC,3);
+            }
+            if(redirect(&cmd->stages[0],&what)<0){
+                printf("%s: %s\n",what,strerror(errno));
+                laststatus = 1;
+            }
+            else{
+                builtin_cmd(cmd->argv);
+                fflush(stdout);
+            }
+            for(i=0;i<3;i++){
+                if(saved[i]>=0){
+                    dup2(saved[i],i);
+                    close(saved[i]);
+                }
+            }
+        }
+        else{
+            builtin_cmd(cmd->argv);
+        }
+        if(cmd->timed){  //The shell's own usage plus that of any children reaped meanwhile
+            clock_gettime(CLOCK_MONOTONIC,&t1);
+            getrusage(RUSAGE_SELF,&self1);
+            getrusage(RUSAGE_CHILDREN,&child1);
+            timersub(&self1.ru_utime,&self0.ru_utime,&self1.ru_utime);
+            timersub(&self1.ru_stime,&self0.ru_stime,&self1.ru_stime);
+            timersub(&child1.ru_utime,&child0.ru_utime,&child1.ru_utime);
+            timersub(&child1.ru_stime,&child0.ru_stime,&child1.ru_stime);
+            timeradd(&self1.ru_utime,&child1.ru_utime,&self1.ru_utime);
+            timeradd(&self1.ru_stime,&child1.ru_stime,&self1.ru_stime);
+            self1.ru_nvcsw += child1.ru_nvcsw-child0.ru_nvcsw-self0.ru_nvcsw;
+            self1.ru_nivcsw += child1.ru_nivcsw-child0.ru_nivcsw-self0.ru_nivcsw;
+            if(child1.ru_maxrss>self1.ru_maxrss){
+                self1.ru_maxrss = child1.ru_maxrss;
+            }
+            printtimes((t1.tv_sec-t0.tv_sec)+(t1.tv_nsec-t0.tv_nsec)/1e9,&self1);
+        }
+        return;
+    }
+
+    //A client of the job server has no terminal to run a foreground job on
+    if(client!=NULL){
+        cmd->bg = 1;
+    }
+
+    /*
+     * A background job waits in the queue if its limits are set, and starts once they allow it.
+     * It is parsed again from its command line then.
+     */
+    if(cmd->bg && qactive()){
+        if(addjob(&jobs,0,QU,cmdline)){
+            job = jobs.tail;
+            job->prio = cmd->prio;
+            qpush(job);
+            es_begin("queued",job);
+            es_printf(",\"prio\":%d",job->prio);
+            es_string("cmd",cmdline);
+            es_end();
+            i = job->jid;
+            qadmit();
+            if((job=getjobjid(&jobs,i))!=NULL && job->state==QU){ //Otherwise it was started (or failed to) at once
+                printf("[%d] (queued) %s",job->jid,cmdline);
+            }
+            laststatus = 0;
+        }
+        return;
+    }
+
+    /*
+     * Otherwise, all commands of the pipeline are run in one new process group, placed as asked. There is no need to
+     * block SIGCHLD here: children are only reaped from the event loop, never while eval() runs.
+     */
+    if((job=runcmd(cmd,cmdline,NULL))==NULL){ //Nothing could be started, error was already printed
+        if(!cmd->bg){
+            tty_take(NULL);  //In case a stage got as far as taking the terminal
+        }
+        return;
+    }
+
+    if(cmd->bg){   //For backgroung process
+        printf("[%d] (%d) %s",job->jid,job->pid,cmdline); //Print process-ID and job-ID of the job created
+        laststatus = 0;
+    }
+
+    else{      //for foreground process
+        waitfg(job->pid); //Wait for job to finish, and then give prompt back to the user
+    }
+
+    return;
+}
+
+/* 
+ * parsecmd - Parse a command line into cmd: its words, with the "time",
+ *     "place" and "queue" prefixes taken off, and its pipeline. All of
+ *     it lives in the command arena. Returns 1 if there is a command to
+ *     run, 0 if there is none, or -1 after printing an error.
+ */
+int parsecmd(char *cmdline, struct cmd_t *cmd)
+{
+    char **argv;  //String array to store arguments provided in command line
+    struct redir_t *redirs;  //Redirections of the pipeline's commands
+    int argc;
+
+    /*
+     * Parseline function is used to break command-line string into different arguments and storing them in argv[] array.
+     * It also checks if last character is '&'. If so, it returns 1 to indicate that the process is to be run in background.
+     * All of these arrays live in the command arena, so there is no limit on the number of arguments.
+     */
+    if((cmd->bg=parseline(cmdline,&argv))<0){
+        laststatus = 2;
+        return -1;
+    }
+    cmd->timed = 0;
+    cmd->prio = 0;
+    cmd->place.set = 0;
+    cmd->pure = 1;
+    if(argv[0]==NULL){
+        return 0;
+    }
+    if(strcmp(argv[0],"time")==0){ //"time" reports the resource usage of the rest of the command line once it's over
+        cmd->timed = 1;
+        if((++argv)[0]==NULL){
+            return 0;
+        }
+    }
+    if(strcmp(argv[0],"queue")==0){ //"queue" sets the priority of the rest of the command line in the background job queue
+        cmd->pure = 0;  //It may set the limits too, and "place" the spread mode, which must happen every time
+        if(parsequeue(&argv,&cmd->prio)<0){
+            laststatus = 2;
+            return -1;
+        }
+        if(argv[0]==NULL){
+            return 0;
+        }
+    }
+    if(strcmp(argv[0],"place")==0){ //"place" sets the CPUs, priorities and NUMA node of the rest of the command line
+        cmd->pure = 0;
+        if(parseplace(&argv,&cmd->place)<0){
+            laststatus = 2;
+            return -1;
+        }
+        if(argv[0]==NULL){
+            return 0;
+        }
+    }
+    for(argc=0;argv[argc]!=NULL;argc++)
+        ;
+    cmd->argv = argv;
+    cmd->stages = arena_alloc(argc*sizeof(struct stage_t));
+    redirs = arena_alloc(argc*sizeof(struct redir_t));
+
+    if((cmd->nstages=parsepipe(argv,cmd->stages,redirs))<0){ //Split argv into the commands of a pipeline and their redirections
+        laststatus = 2;
+        return -1;
+    }
+    return 1;
+}
+
+/* 
+ * runcmd - Launch the pipeline of a parsed command line as a job,
+ *     in the foreground or background as it asks. The job is added to
+ *     the job list, unless it's given: a queued job being started.
+ *     Returns the job, or NULL if nothing could be started.
+ */
+struct job_t *runcmd(struct cmd_t *cmd, char *cmdline, struct job_t *job)
+{
+    pid_t *pids;  //PIDs of the started pipeline stages
+    int npids, i, capfd = srvout;  //A client's jobs write to where ours do, not to the client
+    struct outbuf_t *out = NULL;  //Where its output is captured, if it is
+
+    if(cmd->bg && spread!=SP_OFF && !(cmd->place.set & PL_CPUS)){
+        autoplace(&cmd->place);  //Spread background jobs that weren't placed explicitly
+    }
+    for(i=0;i<cmd->nstages;i++){
+        cmd->stages[i].place = cmd->place.set ? &cmd->place : NULL;
+        cmd->stages[i].tty = interactive && !cmd->bg;
+    }
+    if(cmd->bg && capsize>0){
+        out = ob_open(&capfd);  //With -b, a background job writes to a pipe read by the shell instead of the terminal
+    }
+    pids = arena_alloc(cmd->nstages*sizeof(pid_t));
+    npids = launch(cmd->stages,cmd->nstages,pids,capfd);
+    if(out!=NULL){
+        close(capfd);  //Only the children write to it, so the shell sees EOF once they are all gone
+    }
+    if(npids==0){
+        if(out!=NULL){
+            ob_close(out);
+        }
+        laststatus = 127;
+        return NULL;
+    }
+
+    if(job==NULL){
+        if(!addjob(&jobs,pids[0],cmd->bg?BG:FG,cmdline)){ //Add job to the job-table, first PID is the process group ID
+            if(out!=NULL){
+                ob_close(out);
+            }
+            return NULL;
+        }
+        job = jobs.tail;
+        i = 1;
+    }
+    else{
+        job->pid = pids[0];
+        clock_gettime(CLOCK_MONOTONIC,&job->start);
+        setjobstate(&jobs,job,cmd->bg?BG:FG);
+        i = 0;
+    }
+    for(;i<npids;i++){
+        addproc(&jobs,job,pids[i]); //Rest of the pipeline belongs to the same job
+    }
+    if(cmd->timed){
+        job->done = time_done; //Report its resource usage once it's over
+    }
+    job->place = cmd->place; //For jobs -l
+    job->out = out;
+
+    es_begin("spawned",job);
+    es_printf(",\"bg\":%s,\"pids\":[",cmd->bg?"true":"false");
+    for(i=0;i<npids;i++){
+        es_printf(i?",%d":"%d",pids[i]);
+    }
+    es_printf("]");
+    es_string("cmd",cmdline);
+    es_end();
+    return job;
+}
+
+/* 
+ * parsepipe - Split argv at each "|" into the commands of a pipeline,
+ *     and move the redirections "< file", "> file", ">> file" and
+ *     "2>&1" out of each command's arguments into redirs. Returns the
+ *     number of commands, or prints an error and returns -1 if the
+ *     pipeline is malformed.
+ */
+int parsepipe(char **argv, struct stage_t *stages, struct redir_t *redirs)
+{
+    int i, w = 0, n = 0, nr = 0;
+    struct redir_t *r;
+    char *tok;
+
+    stages[0].argv = argv;
+    stages[0].redirs = redirs;
+    stages[0].nredirs = 0;
+    for (i = 0; (tok = argv[i]) != NULL; i++) {
+	if (tok == optab[OPIPE]) {
+	    if (stages[n].argv == &argv[w])
+		goto syntax;
+	    argv[w++] = NULL;
+	    n++;
+	    stages[n].argv = &argv[w];
+	    stages[n].redirs = &redirs[nr];
+	    stages[n].nredirs = 0;
+	    continue;
+	}
+	if (tok == optab[ODUP]) {
+	    r = &redirs[nr++];
+	    r->fd = STDERR_FILENO;
+	    r->path = NULL;
+	    r->dupfd = STDOUT_FILENO;
+	    stages[n].nredirs++;
+	    continue;
+	}
+	if (tok == optab[OIN] || tok == optab[OOUT] || tok == optab[OAPPEND]) {
+	    if (argv[i+1] == NULL || isop(argv[i+1])) {
+		tok = argv[i+1];
+		goto syntax;
+	    }
+	    r = &redirs[nr++];
+	    if (tok == optab[OIN]) {
+		r->fd = STDIN_FILENO;
+		r->flags = O_RDONLY;
+	    }
+	    else {
+		r->fd = STDOUT_FILENO;
+		r->flags = O_WRONLY | O_CREAT | (tok == optab[OAPPEND] ? O_APPEND : O_TRUNC);
+	    }
+	    r->path = argv[++i];
+	    stages[n].nredirs++;
+	    continue;
+	}
+	if (isop(tok))  /* & only at the end, where parseline removed it */
+	    goto syntax;
+	argv[w++] = tok;
+    }
+    argv[w] = NULL;
+    if (stages[n].argv[0] != NULL)
+	return n + 1;
+
+ syntax:
+    printf("Syntax error near '%s'\n", tok != NULL ? tok : "newline");
+    return -1;
+}
+
+/* 
+ * redirect - Apply a command's redirections to the calling process.
+ *     Only uses system calls, so it is safe in a vfork() child. On
+ *     failure, returns -1 with errno set and *what naming the file.
+ */
+int redirect(struct stage_t *stage, char **what)
+{
+    struct redir_t *r;
+    int i, fd;
+
+    for (i = 0; i < stage->nredirs; i++) {
+	r = &stage->redirs[i];
+	if (r->path == NULL) {
+	    fd = r->dupfd;
+	}
+	else if ((fd = open(r->path, r->flags | O_CLOEXEC, 0666)) < 0) {
+	    *what = r->path;
+	    return -1;
+	}
+	if (fd != r->fd && dup2(fd, r->fd) < 0) {
+	    *what = r->path != NULL ? r->path : "dup2";
+	    if (r->path != NULL)
+		close(fd);
+	    return -1;
+	}
+	if (r->path == NULL)
+	    continue;
+	if (fd != r->fd)
+	    close(fd);  /* a builtin runs on in the shell, which must not keep it */
+	else
+	    fcntl(fd, F_SETFD, 0);  /* opened right into place: keep it across exec */
+    }
+    return 0;
+}
+
+/* 
+ * launch - Start the commands of a pipeline, connected by pipes, in
+ *     one new process group led by the first of them. Stores the PIDs
+ *     of the started commands in pids and returns how many there are.
+ *     A command that can't be started is reported and left out; its
+ *     neighbours then see EOF or EPIPE on their pipes. Unless capfd is
+ *     -1, it becomes the stdout of the last command and the stderr of
+ *     all of them; the caller keeps it open.
+ *
+ * With a zygote, the requests for all commands are sent first and the
+ * PIDs are collected afterwards, so the zygote creates the processes
+ * back to back. A command the zygote can't take is started directly,
+ * as are the ones after it.
+ */
+int launch(struct stage_t *stages, int nstages, pid_t *pids, int capfd)
+{
+    int fds[2], in = -1, i, npids = 0, nsent = 0, nrecv = 0, zerr = 0;
+    pid_t pid, pgid = 0;
+    long long t0 = ph_now();
+
+    fflush(stdout);  //Our output so far must come before the children's
+
+    for (i = 0; i < nstages; i++) {
+	stages[i].infd = in;
+	stages[i].outfd = in = -1;
+	stages[i].errfd = capfd;
+	if (i == nstages - 1)
+	    stages[i].outfd = capfd;
+	else {
+	    if (pipe2(fds, O_CLOEXEC) < 0) {
+		printf("pipe error: %s\n", strerror(errno));
+		if (stages[i].infd >= 0)
+		    close(stages[i].infd);
+		break;
+	    }
+	    fcntl(fds[1], F_SETPIPE_SZ, PIPESZ); /* best effort, may exceed pipe-max-size */
+	    stages[i].outfd = fds[1];
+	    in = fds[0];
+	}
+
+	stages[i].path = strchr(stages[i].argv[0], '/') ? NULL : hashfind(stages[i].argv[0]);
+	if (zygote >= 0 && nsent == i && (zerr = zsend(&stages[i], i > 0)) == 0)
+	    nsent++;
+	else {
+	    /* Directly, in the group of the stages the zygote started, if any */
+	    for (; nrecv < nsent; nrecv++)
+		if ((pid = zrecv(&stages[nrecv])) > 0) {
+		    if (pgid == 0)
+			pgid = pid;
+		    pids[npids++] = pid;
+		}
+	    if (zerr < 0 && zygote >= 0) {  /* the zygote is gone */
+		close(zygote);
+		zygote = -1;
+	    }
+	    fflush(stdout);
+	    if ((pid = spawn(&stages[i], pgid)) > 0) {
+		if (pgid == 0)
+		    pgid = pid;
+		pids[npids++] = pid;
+	    }
+	}
+
+	if (stages[i].infd >= 0)
+	    close(stages[i].infd);
+	if (stages[i].outfd >= 0 && stages[i].outfd != capfd)
+	    close(stages[i].outfd);
+    }
+    for (; nrecv < nsent; nrecv++)
+	if ((pid = zrecv(&stages[nrecv])) > 0)
+	    pids[npids++] = pid;
+    ph_add(PH_SPAWN, ph_now() - t0);
+    return npids;
+}
+
+/* 
+ * setupchild - Prepare a new child for running a pipeline stage: join
+ *     process group pgid, restore the signal mask, apply the job's
+ *     placement and install the pipes and redirections. Only uses
+ *     system calls, so it is safe in a vfork() child. Returns -1 with
+ *     errno set and *what naming the file if a redirection fails, or
+ *     "place" if the placement can't be applied.
+ */
+static int setupchild(struct stage_t *stage, pid_t pgid, char **what)
+{
+    setpgid(0,pgid);
+    if(stage->tty){  //Take the terminal before exec, while SIGTTOU is still blocked, so the job never reads it from the background
+        tcsetpgrp(STDIN_FILENO,pgid ? pgid : getpid());
+    }
+    sigprocmask(SIG_SETMASK, &origmask, NULL);  //Child must not inherit the signals blocked for the signalfd
+    if(stage->place!=NULL && applyplace(stage->place)<0){
+        *what = "place";
+        return -1;
+    }
+    if(stage->infd>=0) dup2(stage->infd,STDIN_FILENO);
+    if(stage->outfd>=0) dup2(stage->outfd,STDOUT_FILENO);
+    if(stage->errfd>=0) dup2(stage->errfd,STDERR_FILENO);
+    return redirect(stage,what);
+}
+
+/* 
+ * execstage - Exec a pipeline stage, from the PATH lookup cache if it
+ *     is there. Should the cached file have gone, *stale is set and
+ *     PATH is searched again. Only returns if that failed too.
+ */
+static void execstage(struct stage_t *stage, volatile int *stale)
+{
+    if(stage->path!=NULL){
+        execv(stage->path,stage->argv);
+        *stale = 1;
+    }
+    execvp(stage->argv[0],stage->argv);
+}
+
+/* 
+ * spawn - Run a pipeline stage in a new child process that joins
+ *     process group pgid (0 to lead a new group), with the stage's
+ *     descriptors installed as its stdin and stdout. Returns the
+ *     child's PID, or -1 with errno set if no child could be created
+ *     or the program could not be executed, after printing why.
+ *
+ * By default the child is created with vfork(), which neither copies
+ * the page tables nor returns to the parent before the child has
+ * exec'd, so the cost of a launch doesn't grow with the shell's
+ * address space and exec or redirection failures are reported back
+ * through shared memory. With -F, or if vfork() fails, fork() is used
+ * instead, and the child reports such failures through a close-on-exec
+ * pipe, as the zygote's children do. A cached path that has gone is
+ * then checked for beforehand, since a child whose execvp() succeeds
+ * can't report it.
+ */
+pid_t spawn(struct stage_t *stage, pid_t pgid)
+{
+    char **argv = stage->argv;
+    volatile int childerr = 0;  //set by a vfork child whose exec failed
+    volatile int stale = 0;     //set by a vfork child if the cached path of argv[0] is gone
+    char *volatile childwhat = NULL;  //file whose redirection failed, NULL if exec failed
+    volatile long long execat = 0;    //when a vfork child called exec
+    long long t0 = ph_now();
+    struct zreply_t rep;  //a fork child's report, only sent if it fails
+    int errpipe[2];
+    ssize_t n;
+    char *what;
+    pid_t pid;
+
+    if(!usefork && (pid=vfork())>=0){
+        if(pid==0){
+            signal(SIGQUIT, SIG_DFL);  //Never run the shell's handler on the shared stack
+            if(setupchild(stage,pgid,&what)<0){
+                childwhat = what;
+            }
+            else{
+                execat = ph_now();  //Only reads the vDSO clock, no system call
+                execstage(stage,&stale);
+            }
+            childerr = errno;  //Parent sees this once we _exit
+            _exit(127);
+        }
+        if(stale){
+            hashdrop(argv[0]);
+        }
+        if(childerr==0){
+            ph_add(PH_EXEC,execat-t0);
+            return pid;
+        }
+    }
+    else{
+        if(stage->path!=NULL && access(stage->path,X_OK)<0){
+            stage->path = NULL;  //hashdrop frees it
+            hashdrop(argv[0]);
+        }
+        if(pipe2(errpipe,O_CLOEXEC)<0){
+            int err = errno;
+            printf("pipe error: %s\n",strerror(err));
+            errno = err;
+            return -1;
+        }
+        if((pid=fork())==0){
+            memset(&rep,0,sizeof(rep));
+            what = NULL;
+            if(setupchild(stage,pgid,&what)==0){
+                execstage(stage,&stale);
+            }
+            rep.err = errno;
+            rep.whatlen = what!=NULL ? strlen(what) : 0;
+            if(write(errpipe[1],&rep,sizeof(rep))==sizeof(rep) && rep.whatlen>0){
+                write(errpipe[1],what,rep.whatlen);
+            }
+            _exit(127);  //Not exit(): the stdio buffers we share with the shell must not be flushed twice
+        }
+        close(errpipe[1]);
+        if(pid<0){
+            int err = errno;
+            close(errpipe[0]);
+            printf("%s: %s\n",argv[0],strerror(err));  //No process to run it in (EAGAIN, ENOMEM), the command itself may be fine
+            errno = err;
+            return -1;
+        }
+        setpgid(pid, pgid ? pgid : pid);  //Also set it from the parent, so it holds before we signal the group
+        while((n=read(errpipe[0],&rep,sizeof(rep)))<0 && errno==EINTR)
+            ;
+        if(n==sizeof(rep)){  //EOF instead means it got as far as exec
+            childerr = rep.err;
+            if(rep.whatlen>0){
+                childwhat = arena_alloc(rep.whatlen+1);
+                n = read(errpipe[0],childwhat,rep.whatlen);
+                childwhat[n>0 ? n : 0] = '\0';
+            }
+        }
+        close(errpipe[0]);
+        if(childerr==0){
+            return pid;
+        }
+    }
+
+    //exec failed, so reap the child right away, it never becomes a job
+    waitpid(pid,NULL,0);
+    if(childwhat!=NULL){
+        printf("%s: %s\n",childwhat,strerror(childerr));
+    }
+    else if(childerr==ENOENT){
+        printf("%s: Command not found\n",argv[0]);
+    }
+    else{
+        printf("%s: %s\n",argv[0],strerror(childerr));  //Found, but not runnable (EACCES, ENOEXEC, ...)
+    }
+    errno = childerr;
+    return -1;
+}
+
+/* 
+ * parseline - Parse the command line and build the argv array.
+ * 
+ * Words are separated by spaces or tabs. Characters enclosed in single
+ * quotes are taken literally; within double quotes, a backslash
+ * escapes one of \ " $ or `; outside quotes it escapes any character.
+ * Quoted and unquoted parts that touch form a single argument. The
+ * operators | < > >> 2>&1 and & need not be surrounded by spaces, and
+ * are stored in argv as pointers into optab, as are ; && and ||,
+ * which eval() has already split the line at. A word with an unquoted
+ * *, ? or [ is a pattern, replaced by the pathnames it matches, if any.
+ *
+ * The words are unquoted in place in a single copy of the command line,
+ * from the command arena, and runs of ordinary characters are found
+ * with strcspn(), which the C library vectorizes. Return true if the
+ * user has requested a BG job, false if the user has requested a FG
+ * job, or print an error and return -1 if a quote isn't closed.
+ */
+int parseline(const char *cmdline, char ***argvp) 
+{
+    char *base, *buf;           /* local copy of the command line, and ptr that traverses it */
+    char *w;                    /* where the current word is unquoted to */
+    char *start;                /* where it starts */
+    char *op;                   /* operator that ends it, if any */
+    char **argv;                /* argument list */
+    size_t n, k;                /* length of a run of literal characters */
+    size_t cap;                 /* allocated size of argv */
+    int argc;                   /* number of args */
+    int bg;                     /* background job? */
+    int glob;                   /* the word has an unquoted *, ? or [ */
+    struct globctx_t ctx;
+    long long t0 = ph_now();
+
+    base = buf = strcpy(arena_alloc(strlen(cmdline)+1), cmdline);
+
+    /* Every word or operator takes at least one character, which bounds
+     * their number until a pattern expands to more */
+    cap = strlen(cmdline) + 2;
+    *argvp = argv = arena_alloc(cap * sizeof(char *));
+
+    /* Build the argv list */
+    argc = 0;
+    for (;;) {
+	buf += strspn(buf, " \t\n"); /* ignore spaces */
+	if (*buf == '\0')
+	    break;
+	if ((op = lexop(&buf)) != NULL) {
+	    argv[argc++] = op;
+	    continue;
+	}
+
+	argv[argc++] = w = start = buf;
+	glob = 0;
+	for (;;) {
+	    n = strcspn(buf, " \t\n'\"\\|<>&;");
+	    for (k = 0; k < n && !glob; k++)
+		glob = buf[k] == '*' || buf[k] == '?' || buf[k] == '[';
+	    if (w != buf)
+		memmove(w, buf, n);
+	    w += n;
+	    buf += n;
+	    if (*buf == '\'') {
+		if ((op = strchr(buf + 1, '\'')) == NULL)
+		    goto unterminated;
+		n = op - (buf + 1);
+		memmove(w, buf + 1, n);
+		w += n;
+		buf = op + 1;
+	    }
+	    else if (*buf == '"') {
+		for (buf++; ; buf++) {
+		    n = strcspn(buf, "\"\\");
+		    memmove(w, buf, n);
+		    w += n;
+		    buf += n;
+		    if (*buf == '\0')
+			goto unterminated;
+		    if (*buf == '"')
+			break;
+		    if (buf[1] != '\0' && strchr("\\\"$`", buf[1]) != NULL)
+			buf++;
+		    *w++ = *buf;
+		}
+		buf++;
+	    }
+	    else if (*buf == '\\') {
+		if (buf[1] != '\0' && buf[1] != '\n')
+		    buf++;
+		*w++ = *buf++;
+	    }
+	    else
+		break;  /* a space, an operator or the end of the line */
+	}
+
+	/* A pattern is expanded from its source text, where quoting still
+	 * tells which of its characters are special */
+	if (glob) {
+	    ctx.argvp = argvp;
+	    ctx.argcp = &argc;
+	    ctx.capp = &cap;
+	    ctx.reserve = strlen(buf) + 2;
+	    argc--;
+	    if (globexpand(globpat(cmdline + (start - base), buf - start), &ctx) == 0)
+		argc++;  /* no match: the word stays as it is */
+	    argv = *argvp;
+	}
+
+	/* Terminating the word may overwrite what ends it, so consume that first */
+	if ((op = lexop(&buf)) == NULL && *buf != '\0')
+	    buf++;
+	*w = '\0';
+	if (op != NULL)
+	    argv[argc++] = op;
+    }
+    argv[argc] = NULL;
+    ph_add(PH_PARSE, ph_now() - t0);
+    
+    if (argc == 0)  /* ignore blank line */
+	return 1;
+
+    /* should the job run in the background? */
+    if ((bg = (argv[argc-1] == optab[OBG])) != 0) {
+	argv[--argc] = NULL;
+    }
+    return bg;
+
+ unterminated:
+    printf("Syntax error: unterminated %c\n", *buf == '\0' ? '"' : *buf);
+    argv[0] = NULL;
+    return -1;
+}
+
+/* 
+ * lexop - If *bufp starts with an operator, advance it past the operator
+ *     and return its entry in optab, otherwise return NULL
+ */
+char *lexop(char **bufp)
+{
+    char *buf = *bufp, *op;
+
+    if (strncmp(buf, "2>&1", 4) == 0)
+	op = optab[ODUP];
+    else if (buf[0] == '>')
+	op = buf[1] == '>' ? optab[OAPPEND] : optab[OOUT];
+    else if (buf[0] == '<')
+	op = optab[OIN];
+    else if (buf[0] == '|')
+	op = buf[1] == '|' ? optab[OOR] : optab[OPIPE];
+    else if (buf[0] == '&')
+	op = buf[1] == '&' ? optab[OAND] : optab[OBG];
+    else if (buf[0] == ';')
+	op = optab[OSEMI];
+    else
+	return NULL;
+    *bufp = buf + strlen(op);
+    return op;
+}
+
+/* 
+ * isbuiltin - Return true if argv is a command that builtin_cmd() would execute itself
+ */
+int isbuiltin(char **argv)
+{
+    struct stat st;
+    int i;
+
+    if(strcmp(argv[0],"cat")==0){  //cat is only built in without options, and for regular files, which never block
+        for(i=1;argv[i]!=NULL;i++){
+            if(argv[i][0]=='-' || stat(argv[i],&st)<0 || !S_ISREG(st.st_mode)){
+                return 0;
+            }
+        }
+        return i>1;  //Not for stdin, which may be a terminal, a pipe or the shell's own input
+    }
+    return findbuiltin(argv[0])!=NULL;
+}
+
+static int cmpbuiltin(const void *name, const void *b)
+{
+    return strcmp(name,((const struct builtin_t *)b)->name);
+}
+
+/* 
+ * findbuiltin - Look up a builtin command by name in the sorted table
+ */
+struct builtin_t *findbuiltin(const char *name)
+{
+    return bsearch(name,builtins,NBUILTINS,sizeof(builtins[0]),cmpbuiltin);
+}
+
+/* 
+ * builtin_cmd - If the user has typed a built-in command, then execute it using this function.  
+ */
+int builtin_cmd(char **argv) 
+{
+    long long t0;  //When it started, for stats
+
+    if(!isbuiltin(argv)){
+        return 0;  /* return 0 if it is not a built-in command, so eval function will take care of it. */
+    }
+    if(client!=NULL && !srv_allowed(argv)){  //Those that take over the terminal, or block the server
+        printf("%s: Not available to clients\n",argv[0]);
+        laststatus = 1;
+        return 1;
+    }
+    t0 = ph_now();
+    laststatus = findbuiltin(argv[0])->fn(argv);
+    ph_add(PH_BUILTIN,ph_now()-t0);
+    return 1;
+}
+
+/* 
+ * do_quit - Execute the builtin quit command
+ */
+int do_quit(char **argv)
+{
+    struct job_t *job;
+
+    if(client!=NULL){  //A client quits its connection, not the server
+        client->eof = 1;
+        return 0;
+    }
+    for(job=jobs.head;job!=NULL;job=job->next){ //If there are any jobs in ST (Stopped) state, then give error and do not quit
+        if(job->state==ST){    
+            printf("There are some processes in stopped state so can't quit\n");
+            return 1;
+        }
+    }
+    exit(0); //If not job in ST state, then quit.
+}
+
+/* 
+ * do_jobs - Execute the builtin jobs command
+ */
+int do_jobs(char **argv)
+{
+    struct job_t *job;
+
+    if(argv[1]!=NULL && strcmp(argv[1],"-l")==0){ //jobs -l adds each job's elapsed time and resource usage
+        for(job=jobs.head;job!=NULL;job=job->next){
+            printjob(job,1);
+        }
+        return 0;
+    }
+    listjobs(&jobs); //list all jobs present in job-table using helper listjobs() function
+    return 0;
+}
+
+/* 
+ * do_bgfg - Execute the builtin bg and fg commands
+ */
+int do_bgfg(char **argv) 
+{
+    /*First check for invalid (or missing) arguments*/
+
+    if(argv[1]==NULL){ //if no argument provided
+        printf("fd command requires PID or %cjobid argument\n",'%');
+        return 1;
+    }
+
+    int L=strlen(argv[1]); //stores length of argument provided to fg or bg command
+
+    if(argv[1][0]=='%'){ //if first character in argv[1] is '%', it means job-ID must be provided
+        for(int i=1;i<L;i++){ 
+            if(!(argv[1][i]>='0' && argv[1][i]<='9')){ //if any of next character is not a digit, then it cannot be a valid JID.
+                printf("fg: argument must be a PID or %cjobid\n",'%');
+                return 1;
+            }
+        }
+    }
+
+    else{
+        for(int i=0;i<L;i++){ //if first character in argv[1] is not '%', then it must be a PID
+            if(!(argv[1][i]>='0' && argv[1][i]<='9')){
+                printf("fg: argument must be a PID or %cjobid\n",'%'); //if any character is not a digit, it cannot be a valid PID
+                return 1;
+            }
+        }
+    }
+
+    int num;    //we will store the PID or JID provided as argument here
+
+    struct job_t *jobsPtr;      //this will point to job entry in job-table if provided PID or JID is valid
+
+
+    /*Next part is to extract PID or JID from argument provided*/
+
+    if(argv[1][0]=='%'){ //if it is JID, skip first character
+        num = atoi(argv[1]+1); //obtain JID in number form from the rest of the string
+    }
+
+    
+    else{ //if it is PID, argv[1] already contains PID in string form
+        num = atoi(argv[1]); //convert it to numerical form
+    }
+
+
+    /*Next part is to get job entry corresponding to given PID or JID*/
+
+    if(argv[1][0]=='%'){
+        jobsPtr=getjobjid(&jobs,num);    //search job-table by JID
+    }
+
+    else{
+        jobsPtr=getjobpid(&jobs,num);    //search job-table by PID
+    }
+
+    /* If given JID/PID does not exist in job-table, then give an error */
+    if(jobsPtr==NULL){
+        if(argv[1][0]=='%'){
+            printf("%s: No such job\n",argv[1]);
+            return 1;
+        }
+        else{
+            printf("(%d): No such process\n",num);
+            return 1;
+        }
+    }
+
+
+    /* If the job is queued, start it right away, whatever the queue's limits */
+
+    if(jobsPtr->state == QU){
+        if(strcmp(argv[0],"bg")==0){
+            return !startjob(jobsPtr,BG);
+        }
+        if(!startjob(jobsPtr,FG)){
+            return 1;
+        }
+        waitfg(jobsPtr->pid);
+        return laststatus;
+    }
+
+
+    /* If the job is in ST (Stopped) state */
+
+    if(jobsPtr->state == ST){
+        //if the command is "bg", then resume it in background
+        if(strcmp(argv[0],"bg")==0){
+            setjobstate(&jobs,jobsPtr,BG);    //changing state from ST to BG
+            printf("[%d] (%d) %s",jobsPtr->jid,jobsPtr->pid,jobsPtr->cmdline); //print information about job resumed
+            signaljob(jobsPtr,SIGCONT);     //sends the SIGCONT signal to the process group of that job (not num, which may be a JID) to resume it
+        }
+
+        //if the command is "fg", then resume the job in foreground
+        if(strcmp(argv[0],"fg")==0){
+            setjobstate(&jobs,jobsPtr,FG);    //changing state from ST to FG
+            tty_give(jobsPtr);      //with the terminal as it left it, before it runs again
+            signaljob(jobsPtr,SIGCONT);     //sends the SIGCONT signal to the process group of that job to resume it
+            waitfg(jobsPtr->pid);   //wait for the process to terminate, since it is foreground job
+        }
+    }
+
+
+    /* If the job is not in stop state and the command is "bg", then nothing needs to be done, just print information about it */
+
+    else if(strcmp(argv[0],"bg")==0){
+        printf("[%d] (%d) %s",jobsPtr->jid,jobsPtr->pid,jobsPtr->cmdline);
+    }
+
+
+    /* If the command is "fg" and the process is running in background, then move it to foreground */
+
+    else if(jobsPtr->state == BG && strcmp(argv[0],"fg")==0){
+        setjobstate(&jobs,jobsPtr,FG);    //change the state from BG to FG
+        waitfg(jobsPtr->pid);   //wait for the process to terminate
+    }
+
+    return strcmp(argv[0],"fg")==0 ? laststatus : 0;  //fg takes on the status of the job
+}
+
+/* 
+ * copyfd - Copy everything from in, a regular file, to out without a
+ *     user space copy where the kernel allows it: sendfile() from the
+ *     file, or splice() if out is a pipe, and otherwise read/write.
+ *     The copy goes COPYCHUNK bytes at a time, with the events handled
+ *     in between, so children are reaped and ctrl-c stops it (-1 with
+ *     errno set to EINTR).
+ */
+static int copyfd(int in, int out)
+{
+    char buf[8192];
+    ssize_t n, r = 0, w, off;
+    int how = 0;  /* 0 for sendfile, 1 for splice, 2 for read/write */
+
+    for (;;) {
+	if (how == 0)
+	    n = sendfile(out, in, NULL, COPYCHUNK);
+	else if (how == 1)
+	    n = splice(in, NULL, out, NULL, COPYCHUNK, SPLICE_F_MOVE);
+	else {
+	    for (n = 0; n < COPYCHUNK && (r = read(in, buf, sizeof(buf))) > 0; n += r)
+		for (off = 0; off < r; off += w)
+		    if ((w = write(out, buf + off, r - off)) < 0)
+			return -1;
+	    if (r < 0 && errno != EINTR)
+		return -1;
+	}
+	if (n == 0)
+	    return 0;
+	if (n < 0) {
+	    if (how < 2 && (errno == EINVAL || errno == ENOSYS)) {
+		how++;
+		continue;
+	    }
+	    if (errno != EINTR)
+		return -1;
+	}
+	ev_wait(0);
+	if (!waiting) {
+	    errno = EINTR;
+	    return -1;
+	}
+    }
+}
+
+/* 
+ * do_cat - Execute the builtin cat command: copy the named files to
+ *     stdout. isbuiltin() leaves any other cat to the external one.
+ */
+int do_cat(char **argv)
+{
+    int i, fd, ret = 0;
+
+    fflush(stdout);  //Whatever the shell printed so far comes first
+    waiting = 1;  //Until ctrl-c
+    for(i=1;argv[i]!=NULL;i++){
+        if((fd=open(argv[i],O_RDONLY|O_CLOEXEC))<0){
+            printf("cat: %s: %s\n",argv[i],strerror(errno));
+            ret = 1;
+            continue;
+        }
+        if(copyfd(fd,STDOUT_FILENO)<0){
+            close(fd);
+            if(!waiting){
+                return 130;  //interrupted by ctrl-c
+            }
+            printf("cat: %s: %s\n",argv[i],strerror(errno));
+            ret = 1;
+            continue;
+        }
+        close(fd);
+    }
+    waiting = 0;
+    return ret;
+}
+
+/* 
+ * do_hash - Execute the builtin hash command. Without arguments, list
+ *     the PATH lookup cache; with -r, empty it; otherwise look up each
+ *     named command and add it to the cache.
+ */
+int do_hash(char **argv)
+{
+    struct pathent_t *e;
+    int i, status = 0;
+
+    if(argv[1]==NULL){
+        for(i=0;i<PATHHASH;i++){
+            for(e=pathhash[i];e!=NULL;e=e->next){
+                printf("%s\t%s\n",e->name,e->path);
+            }
+        }
+        return 0;
+    }
+    if(strcmp(argv[1],"-r")==0){
+        hashclear();
+        return 0;
+    }
+    for(i=1;argv[i]!=NULL;i++){
+        if(strchr(argv[i],'/')==NULL && hashfind(argv[i])==NULL){
+            printf("hash: %s: not found\n",argv[i]);
+            status = 1;
+        }
+    }
+    return status;
+}
+
+/* 
+ * printtimes - Print the elapsed time and resource usage of a command
+ */
+void printtimes(double real, struct rusage *ru)
+{
+    double user = ru->ru_utime.tv_sec + ru->ru_utime.tv_usec/1e6;
+    double sys = ru->ru_stime.tv_sec + ru->ru_stime.tv_usec/1e6;
+
+    printf("\nreal\t%dm%.3fs\n",(int)(real/60),real-60*(int)(real/60));
+    printf("user\t%dm%.3fs\n",(int)(user/60),user-60*(int)(user/60));
+    printf("sys\t%dm%.3fs\n",(int)(sys/60),sys-60*(int)(sys/60));
+    printf("maxrss\t%ldKB\n",ru->ru_maxrss);
+    printf("csw\t%ld voluntary, %ld involuntary\n",ru->ru_nvcsw,ru->ru_nivcsw);
+}
+
+/* 
+ * time_done - Done callback of a job run under the time builtin
+ */
+void time_done(struct job_t *job, int status)
+{
+    printtimes((job->end.tv_sec-job->start.tv_sec)+(job->end.tv_nsec-job->start.tv_nsec)/1e9,&job->ru);
+}
+
+/* 
+ * parallel_done - Done callback of the jobs started by the parallel
+ *     builtin: report how the item ended and free its slot
+ */
+static void parallel_done(struct job_t *job, int status)
+{
+    char *item = job->data;
+
+    if(WIFEXITED(status)){
+        printf("parallel: %s: exit %d\n",item,WEXITSTATUS(status));
+    }
+    else{
+        printf("parallel: %s: terminated by signal %d\n",item,WTERMSIG(status));
+    }
+    if(!WIFEXITED(status) || WEXITSTATUS(status)!=0){
+        prun->failed++;
+    }
+    prun->running--;
+    free(item);
+    job->data = NULL;
+}
+
+/* 
+ * parallel_start - Start the command of a parallel run for one item, as
+ *     a background job. Every {} in the command is replaced by the item;
+ *     without any {}, the item is appended as the last argument.
+ */
+static void parallel_start(struct prun_t *run, char *item)
+{
+    struct stage_t stage;
+    char **argv, *cmdline, *p, *q;
+    size_t len, ilen = strlen(item), clen = 0;
+    int n, i, subst = 0, ok, capfd = -1;
+    pid_t pid;
+    struct job_t *job;
+    struct outbuf_t *out = NULL;
+
+    for(n=0;run->cmd[n]!=NULL;n++)
+        ;
+    if((argv=calloc(n+2,sizeof(char *)))==NULL){
+        unix_error("calloc error");
+    }
+    for(i=0;i<n;i++){
+        //Count the {} in this word to size the result
+        for(len=0,p=run->cmd[i];(p=strstr(p,"{}"))!=NULL;p+=2)
+            len++;
+        if(len==0){
+            argv[i] = strdup(run->cmd[i]);
+        }
+        else if((argv[i]=malloc(strlen(run->cmd[i])+len*ilen+1))!=NULL){
+            subst = 1;
+            for(p=run->cmd[i],q=argv[i];*p;){
+                if(p[0]=='{' && p[1]=='}'){
+                    q = stpcpy(q,item);
+                    p += 2;
+                }
+                else{
+                    *q++ = *p++;
+                }
+            }
+            *q = '\0';
+        }
+        if(argv[i]==NULL){
+            unix_error("malloc error");
+        }
+    }
+    if(!subst){
+        argv[n++] = strdup(item);
+    }
+
+    //The job's command line is the words joined by spaces
+    for(i=0;i<n;i++)
+        clen += strlen(argv[i])+1;
+    if((cmdline=malloc(clen+1))==NULL){
+        unix_error("malloc error");
+    }
+    for(i=0,q=cmdline;i<n;i++){
+        q = stpcpy(q,argv[i]);
+        *q++ = i<n-1 ? ' ' : '\n';
+    }
+    *q = '\0';
+
+    memset(&stage,0,sizeof(stage));
+    stage.argv = argv;
+    run->nitems++;
+    if(capsize>0){
+        out = ob_open(&capfd);  //Each item's output then comes in one piece, when it is done
+    }
+    ok = launch(&stage,1,&pid,capfd)==1 && addjob(&jobs,pid,BG,cmdline);
+    if(capfd>=0){
+        close(capfd);
+    }
+    if(!ok && out!=NULL){
+        ob_close(out);
+    }
+    if(ok){
+        job = getjobpid(&jobs,pid);
+        job->out = out;
+        job->done = parallel_done;
+        job->data = strdup(item);
+        run->running++;
+    }
+    else{
+        printf("parallel: %s: exit 127\n",item);
+        run->failed++;
+    }
+
+    for(i=0;i<n;i++)
+        free(argv[i]);
+    free(argv);
+    free(cmdline);
+}
+
+/* 
+ * prun_signal - Send sig to every item of the parallel run in progress.
+ *     Once interrupted or stopped, a run starts no further items.
+ */
+void prun_signal(int sig)
+{
+    struct job_t *job;
+
+    prun->stop = 1;
+    for(job=jobs.head;job!=NULL;job=job->next){
+        if(job->done==parallel_done){
+            signaljob(job,sig);
+        }
+    }
+}
+
+/* 
+ * do_parallel - Execute the builtin parallel command:
+ *
+ *     parallel [-j N] command [args ...] [::: item ...]
+ *
+ * Runs command once per item, at most N (default: the number of CPUs)
+ * at a time, starting the next one as soon as one is done. Items are
+ * taken from the arguments after :::, or else one per line from stdin.
+ * Each item runs as a background job and its exit status is reported
+ * when it's over. ctrl-c and ctrl-z go to all running items; after
+ * ctrl-z the stopped items stay in the job list, and the items not yet
+ * started are dropped.
+ */
+int do_parallel(char **argv)
+{
+    struct prun_t run;
+    struct linebuf_t rd, *in = NULL;
+    struct job_t *job;
+    char **items = NULL, *item;
+    long maxjobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1, more = 1;
+    size_t len;
+
+    if(argv[i]!=NULL && strncmp(argv[i],"-j",2)==0){
+        maxjobs = atol(argv[i][2] ? argv[i]+2 : argv[++i] ? argv[i] : "0");
+        i += argv[i]!=NULL;
+    }
+    if(argv[i]==NULL || strcmp(argv[i],":::")==0 || maxjobs<1){
+        printf("usage: parallel [-j N] command [args ...] [::: item ...]\n");
+        return 2;
+    }
+    memset(&run,0,sizeof(run));
+    run.cmd = &argv[i];
+    for(;argv[i]!=NULL;i++){
+        if(strcmp(argv[i],":::")==0){
+            argv[i] = NULL;
+            items = &argv[i+1];
+            break;
+        }
+    }
+    if(items==NULL){  //Read items from stdin, through the shell's own reader if that's where commands come from
+        if(input.fd==STDIN_FILENO){
+            in = &input;
+        }
+        else{
+            lb_init(&rd,STDIN_FILENO);
+            in = &rd;
+        }
+    }
+
+    prun = &run;
+    while(1){
+        while(more && !run.stop && run.running<maxjobs){
+            if(items!=NULL){
+                if((item=*items)==NULL){
+                    more = 0;
+                    break;
+                }
+                items++;
+                parallel_start(&run,item);
+            }
+            else{
+                if((item=lb_getline(in))==NULL){
+                    more = 0;
+                    break;
+                }
+                if((len=strlen(item))>0 && item[len-1]=='\n'){
+                    item[len-1] = '\0';
+                }
+                if(item[0]!='\0'){
+                    item = strdup(item);  //the reader reuses its line buffer
+                    parallel_start(&run,item);
+                    free(item);
+                }
+            }
+        }
+        if(run.running==0){
+            break;
+        }
+        if(run.stop){
+            //Interrupted: wait for the items to die, or leave them stopped in the job list
+            for(job=jobs.head;job!=NULL;job=job->next){
+                if(job->done==parallel_done && job->state!=ST){
+                    break;
+                }
+            }
+            if(job==NULL){
+                break;
+            }
+        }
+        ev_wait(-1);
+    }
+    prun = NULL;
+
+    //Stopped items live on as ordinary jobs
+    for(job=jobs.head;job!=NULL;job=job->next){
+        if(job->done==parallel_done){
+            free(job->data);
+            job->data = NULL;
+            job->done = NULL;
+        }
+    }
+    if(in==&rd){
+        lb_free(&rd);
+    }
+    else if(in==&input && isatty(input.fd)){
+        input.eof = 0;  //ctrl-d ended the items, not the shell
+    }
+    if(run.failed>0){
+        printf("parallel: %d of %d items failed\n",run.failed,run.nitems);
+    }
+    return run.failed>0 || run.stop;
+}
+
+/* 
+ * escchar - Return the character denoted by the backslash escape at
+ *     *pp (\n, \t, \\, \0nnn, ...) and advance *pp to its last character
+ */
+static int escchar(char **pp)
+{
+    char *p = *pp + 1;
+    int c, n;
+
+    switch(*p){
+    case 'a': c = '\a'; break;
+    case 'b': c = '\b'; break;
+    case 'e': c = 033; break;
+    case 'f': c = '\f'; break;
+    case 'n': c = '\n'; break;
+    case 'r': c = '\r'; break;
+    case 't': c = '\t'; break;
+    case 'v': c = '\v'; break;
+    case '\\': c = '\\'; break;
+    case '0':
+        for(c=0,n=0;n<3 && p[1]>='0' && p[1]<='7';n++){
+            c = c*8+(*++p-'0');
+        }
+        break;
+    case '\0':  //a lone backslash at the end stands for itself
+        p--;
+        c = '\\';
+        break;
+    default:
+        *pp = p-1;
+        return '\\';
+    }
+    *pp = p;
+    return c;
+}
+
+/* 
+ * do_echo - Execute the builtin echo command: print the arguments
+ *     separated by spaces. -n omits the newline, -e interprets
+ *     backslash escapes.
+ */
+int do_echo(char **argv)
+{
+    int nl = 1, esc = 0, i;
+    char *p;
+
+    for(i=1;argv[i]!=NULL && argv[i][0]=='-' && argv[i][1]!='\0' && strspn(argv[i]+1,"ne")==strlen(argv[i]+1);i++){
+        nl &= strchr(argv[i],'n')==NULL;
+        esc |= strchr(argv[i],'e')!=NULL;
+    }
+    for(;argv[i]!=NULL;i++){
+        if(!esc){
+            fputs(argv[i],stdout);
+        }
+        else{
+            for(p=argv[i];*p;p++){
+                if(p[0]=='\\' && p[1]=='c'){
+                    return 0;  //\c ends the output
+                }
+                putchar(*p=='\\' ? escchar(&p) : *p);
+            }
+        }
+        if(argv[i+1]!=NULL){
+            putchar(' ');
+        }
+    }
+    if(nl){
+        putchar('\n');
+    }
+    return 0;
+}
+
+/* 
+ * do_printf - Execute the builtin printf command: print the arguments
+ *     under control of the format, which understands backslash escapes
+ *     and the conversions %d %i %u %o %x %X %c %s %b and %%, with flags,
+ *     width and precision. The format is reused as long as arguments
+ *     remain. A missing argument counts as empty or zero.
+ */
+int do_printf(char **argv)
+{
+    char spec[32], *p, *arg, *end, **args;
+    int status = 0, used;
+    size_t n;
+
+    if(argv[1]==NULL){
+        printf("usage: printf format [arguments]\n");
+        return 2;
+    }
+    args = &argv[2];
+    do{
+        used = 0;
+        for(p=argv[1];*p;p++){
+            if(*p=='\\'){
+                putchar(escchar(&p));
+                continue;
+            }
+            if(*p!='%'){
+                putchar(*p);
+                continue;
+            }
+            if(p[1]=='%'){
+                putchar(*++p);
+                continue;
+            }
+            //Copy the conversion specification, without its conversion character
+            n = 1+strspn(p+1,"-+ #0");
+            n += strspn(p+n,"0123456789");
+            if(p[n]=='.'){
+                n += 1+strspn(p+n+1,"0123456789");
+            }
+            if(p[n]=='\0'){  //the format ends before the conversion character
+                printf("printf: %s: missing conversion\n",p);
+                return 1;
+            }
+            if(n+3>sizeof(spec)){
+                printf("printf: %s: invalid format\n",argv[1]);
+                return 1;
+            }
+            memcpy(spec,p,n);
+            p += n;
+            arg = *args!=NULL ? *args++ : "";
+            used = 1;
+            errno = 0;
+            switch(*p){
+            case 'd': case 'i':
+                strcpy(spec+n,"ld");
+                printf(spec,strtol(arg,&end,0));
+                break;
+            case 'u': case 'o': case 'x': case 'X':
+                spec[n] = 'l';
+                spec[n+1] = *p;
+                spec[n+2] = '\0';
+                printf(spec,strtoul(arg,&end,0));
+                break;
+            case 'c':
+                strcpy(spec+n,"c");
+                printf(spec,arg[0]);
+                continue;
+            case 's':
+                strcpy(spec+n,"s");
+                printf(spec,arg);
+                continue;
+            case 'b':
+                for(;*arg;arg++){
+                    putchar(*arg=='\\' ? escchar(&arg) : *arg);
+                }
+                continue;
+            default:
+                printf("printf: %%%c: invalid conversion\n",*p);
+                return 1;
+            }
+            if(*end!='\0' || errno!=0){  //numeric conversions
+                printf("printf: %s: invalid number\n",arg);
+                status = 1;
+            }
+        }
+    }while(used && *args!=NULL);
+    return status;
+}
+
+/* 
+ * do_cd - Execute the builtin cd command: change to the given directory,
+ *     $HOME without one, or $OLDPWD for "-", and update PWD and OLDPWD
+ */
+int do_cd(char **argv)
+{
+    char *dir = argv[1], *old, *cwd;
+    int show = 0;
+
+    if(dir==NULL && (dir=getenv("HOME"))==NULL){
+        printf("cd: HOME not set\n");
+        return 1;
+    }
+    if(strcmp(dir,"-")==0){
+        if((dir=getenv("OLDPWD"))==NULL){
+            printf("cd: OLDPWD not set\n");
+            return 1;
+        }
+        show = 1;
+    }
+    old = getcwd(NULL,0);
+    if(chdir(dir)<0){
+        printf("cd: %s: %s\n",dir,strerror(errno));
+        free(old);
+        return 1;
+    }
+    if(old!=NULL){
+        setenv("OLDPWD",old,1);
+        free(old);
+    }
+    if((cwd=getcwd(NULL,0))!=NULL){
+        setenv("PWD",cwd,1);
+        if(show){
+            printf("%s\n",cwd);
+        }
+        free(cwd);
+    }
+    return 0;
+}
+
+/* 
+ * do_pwd - Execute the builtin pwd command
+ */
+int do_pwd(char **argv)
+{
+    char *cwd;
+
+    if((cwd=getcwd(NULL,0))==NULL){
+        printf("pwd: %s\n",strerror(errno));
+        return 1;
+    }
+    printf("%s\n",cwd);
+    free(cwd);
+    return 0;
+}
+
+/* 
+ * testnum - Convert an integer operand of test, or print an error
+ */
+static int testnum(char *s, long *n)
+{
+    char *end;
+
+    errno = 0;
+    *n = strtol(s,&end,10);
+    if(end==s || *end!='\0' || errno!=0){
+        printf("test: %s: integer expression expected\n",s);
+        return -1;
+    }
+    return 0;
+}
+
+/* 
+ * testexpr - Evaluate the test expression of argc words at argv: 0 if
+ *     it is true, 1 if it is false, 2 if it is malformed. The meaning
+ *     depends on the number of words, as in POSIX; longer expressions
+ *     are split at -o, then at -a.
+ */
+static int testexpr(int argc, char **argv)
+{
+    struct stat st;
+    long a, b;
+    int i, r;
+
+    for(i=argc-2;i>0;i--){
+        if(strcmp(argv[i],"-o")==0){
+            if((r=testexpr(i,argv))==2){
+                return 2;
+            }
+            return r==0 ? 0 : testexpr(argc-i-1,argv+i+1);
+        }
+    }
+    for(i=argc-2;i>0;i--){
+        if(strcmp(argv[i],"-a")==0 && argc!=3){
+            if((r=testexpr(i,argv))==2){
+                return 2;
+            }
+            return r!=0 ? 1 : testexpr(argc-i-1,argv+i+1);
+        }
+    }
+
+    switch(argc){
+    case 0:
+        return 1;
+    case 1:
+        return argv[0][0]=='\0';
+    case 2:
+        if(strcmp(argv[0],"!")==0){
+            return !testexpr(1,argv+1);
+        }
+        if(argv[0][0]!='-' || argv[0][1]=='\0' || argv[0][2]!='\0'){
+            break;
+        }
+        switch(argv[0][1]){
+        case 'n': return argv[1][0]=='\0';
+        case 'z': return argv[1][0]!='\0';
+        case 't': return !isatty(atoi(argv[1]));
+        case 'e': return stat(argv[1],&st)<0;
+        case 'f': return stat(argv[1],&st)<0 || !S_ISREG(st.st_mode);
+        case 'd': return stat(argv[1],&st)<0 || !S_ISDIR(st.st_mode);
+        case 'p': return stat(argv[1],&st)<0 || !S_ISFIFO(st.st_mode);
+        case 's': return stat(argv[1],&st)<0 || st.st_size==0;
+        case 'h': case 'L': return lstat(argv[1],&st)<0 || !S_ISLNK(st.st_mode);
+        case 'r': return access(argv[1],R_OK)<0;
+        case 'w': return access(argv[1],W_OK)<0;
+        case 'x': return access(argv[1],X_OK)<0;
+        }
+        break;
+    case 3:
+        if(strcmp(argv[1],"=")==0 || strcmp(argv[1],"==")==0){
+            return strcmp(argv[0],argv[2])!=0;
+        }
+        if(strcmp(argv[1],"!=")==0){
+            return strcmp(argv[0],argv[2])==0;
+        }
+        if(strcmp(argv[1],"<")==0){
+            return strcmp(argv[0],argv[2])>=0;
+        }
+        if(strcmp(argv[1],">")==0){
+            return strcmp(argv[0],argv[2])<=0;
+        }
+        if(argv[1][0]=='-' && strlen(argv[1])==3 && strstr("-eq-ne-lt-le-gt-ge",argv[1])!=NULL){
+            if(testnum(argv[0],&a)<0 || testnum(argv[2],&b)<0){
+                return 2;
+            }
+            switch(argv[1][1]*256+argv[1][2]){
+            case 'e'*256+'q': return !(a==b);
+            case 'n'*256+'e': return !(a!=b);
+            case 'l'*256+'t': return !(a<b);
+            case 'l'*256+'e': return !(a<=b);
+            case 'g'*256+'t': return !(a>b);
+            default:          return !(a>=b);
+            }
+        }
+        if(strcmp(argv[0],"!")==0){
+            return (r=testexpr(2,argv+1))==2 ? 2 : !r;
+        }
+        if(strcmp(argv[0],"(")==0 && strcmp(argv[2],")")==0){
+            return testexpr(1,argv+1);
+        }
+        break;
+    default:
+        if(strcmp(argv[0],"!")==0){
+            return (r=testexpr(argc-1,argv+1))==2 ? 2 : !r;
+        }
+        if(strcmp(argv[0],"(")==0 && strcmp(argv[argc-1],")")==0){
+            return testexpr(argc-2,argv+1);
+        }
+        break;
+    }
+    printf("test: %s: unexpected operator\n",argv[argc>2 ? 1 : 0]);
+    return 2;
+}
+
+/* 
+ * do_test - Execute the builtin test and [ commands
+ */
+int do_test(char **argv)
+{
+    int argc;
+
+    for(argc=0;argv[argc]!=NULL;argc++)
+        ;
+    if(strcmp(argv[0],"[")==0){
+        if(strcmp(argv[argc-1],"]")!=0){
+            printf("[: missing ']'\n");
+            return 2;
+        }
+        argc--;
+    }
+    return testexpr(argc-1,argv+1);
+}
+
+/* 
+ * do_export - Execute the builtin export command: put each NAME=value
+ *     into the environment of the commands the shell runs, or list the
+ *     environment without arguments
+ */
+int do_export(char **argv)
+{
+    char **e;
+    size_t n;
+    int i, status = 0;
+
+    if(argv[1]==NULL){
+        for(e=environ;*e!=NULL;e++){
+            printf("export %s\n",*e);
+        }
+        return 0;
+    }
+    for(i=1;argv[i]!=NULL;i++){
+        n = strcspn(argv[i],"=");
+        if(n==0 || isdigit((unsigned char)argv[i][0]) ||
+           strspn(argv[i],"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_")!=n){
+            printf("export: %s: not a valid identifier\n",argv[i]);
+            status = 1;
+            continue;
+        }
+        if(argv[i][n]=='='){  //A name alone is already exported if it's set at all
+            argv[i][n] = '\0';
+            setenv(argv[i],argv[i]+n+1,1);
+            argv[i][n] = '=';
+        }
+    }
+    return status;
+}
+
+/* 
+ * do_unset - Execute the builtin unset command
+ */
+int do_unset(char **argv)
+{
+    int i;
+
+    for(i=1;argv[i]!=NULL;i++){
+        unsetenv(argv[i]);
+    }
+    return 0;
+}
+
+/* 
+ * signum - Convert a signal name (with or without SIG) or number, or return -1
+ */
+static int signum(const char *name)
+{
+    const char *abbrev;
+    char *end;
+    int sig;
+
+    sig = strtol(name,&end,10);
+    if(end!=name && *end=='\0'){
+        return sig>=0 && sig<NSIG ? sig : -1;
+    }
+    if(strncasecmp(name,"SIG",3)==0){
+        name += 3;
+    }
+    for(sig=1;sig<NSIG;sig++){
+        if((abbrev=sigabbrev_np(sig))!=NULL && strcasecmp(name,abbrev)==0){
+            return sig;
+        }
+    }
+    return -1;
+}
+
+/* 
+ * jobsel - Parse a job set given to kill (after its '%'): N, a range
+ *     N-M or N-%M, or all, running, stopped or queued. Returns -1 if
+ *     it is none of those.
+ */
+static int jobsel(char *s, struct jobsel_t *sel)
+{
+    static const struct { char *name; int states; } sets[] = {
+	{ "all",     1<<FG | 1<<BG | 1<<ST | 1<<QU },
+	{ "running", 1<<FG | 1<<BG },
+	{ "stopped", 1<<ST },
+	{ "queued",  1<<QU },
+    };
+    char *end;
+    size_t i;
+
+    sel->lo = 1;
+    sel->hi = MAXJID;
+    sel->matched = 0;
+    for (i = 0; i < sizeof(sets)/sizeof(sets[0]); i++)
+	if (strcmp(s, sets[i].name) == 0) {
+	    sel->states = sets[i].states;
+	    return 0;
+	}
+    sel->states = 1<<FG | 1<<BG | 1<<ST | 1<<QU;
+    if (!isdigit((unsigned char)*s))
+	return -1;
+    sel->lo = sel->hi = strtol(s, &end, 10);
+    if (*end == '-') {
+	s = end + 1 + (end[1] == '%');
+	if (!isdigit((unsigned char)*s))
+	    return -1;
+	sel->hi = strtol(s, &end, 10);
+    }
+    return *end == '\0' ? 0 : -1;
+}
+
+/* 
+ * do_kill - Execute the builtin kill command: send a signal (SIGTERM by
+ *     default, or -s NAME, -NAME, -N) to each PID, or to every process
+ *     of each job set: %jobid, a range of them such as %1-%200, or
+ *     %all, %running, %stopped or %queued. The job sets are gathered
+ *     first and then signaled in one pass over the job list, each job
+ *     once. A queued job is removed instead. kill -l lists the signal
+ *     names.
+ */
+int do_kill(char **argv)
+{
+    struct job_t *job, *next;
+    struct jobsel_t *sels;
+    int sig = SIGTERM, i = 1, k, nsels = 0, hit, status = 0;
+    pid_t pid;
+
+    if(argv[1]!=NULL && strcmp(argv[1],"-l")==0){
+        for(sig=1;sig<NSIG;sig++){
+            if(sigabbrev_np(sig)!=NULL){
+                printf("%2d) SIG%s\n",sig,sigabbrev_np(sig));
+            }
+        }
+        return 0;
+    }
+    if(argv[1]!=NULL && argv[1][0]=='-'){
+        i++;
+        if((sig=signum(strcmp(argv[1],"-s")==0 && argv[2]!=NULL ? argv[i++] : argv[1]+1))<0){
+            printf("kill: %s: invalid signal specification\n",argv[i-1]);
+            return 1;
+        }
+    }
+    if(argv[i]==NULL){
+        printf("usage: kill [-s sigspec | -sigspec] pid | %cjobid | %cN-M | %call | %crunning | %cstopped | %cqueued ...\n",'%','%','%','%','%','%');
+        return 2;
+    }
+    for(k=i;argv[k]!=NULL;k++)
+        ;
+    sels = arena_alloc((k-i)*sizeof(struct jobsel_t));
+    for(;argv[i]!=NULL;i++){
+        if(argv[i][0]=='%'){  //Gathered for the pass over the job list below
+            if(jobsel(argv[i]+1,&sels[nsels])<0){
+                printf("kill: %s: no such job set\n",argv[i]);
+                status = 1;
+                continue;
+            }
+            sels[nsels++].arg = argv[i];
+            continue;
+        }
+        if((pid=atoi(argv[i]))==0 && strcmp(argv[i],"0")!=0){
+            printf("kill: %s: arguments must be process or job IDs\n",argv[i]);
+            status = 1;
+            continue;
+        }
+        if(signalproc(pid,sig)<0){
+            printf("kill: (%s) - %s\n",argv[i],strerror(errno));
+            status = 1;
+        }
+    }
+
+    //One pass in JID order: every job in any of the sets is signaled once
+    for(job=jobs.head;nsels>0 && job!=NULL;job=next){
+        next = job->next;
+        for(k=hit=0;k<nsels;k++){
+            if(job->jid>=sels[k].lo && job->jid<=sels[k].hi && (sels[k].states & 1<<job->state)){
+                sels[k].matched = hit = 1;
+            }
+        }
+        if(!hit){
+            continue;
+        }
+        if(job->state==QU){  //Not started yet: just drop it
+            qremove(job);
+            removejob(&jobs,job);
+        }
+        else if(signaljob(job,sig)<0){
+            printf("kill: (%c%d) - %s\n",'%',job->jid,strerror(errno));
+            status = 1;
+        }
+    }
+    for(k=0;k<nsels;k++){
+        if(!sels[k].matched && isdigit((unsigned char)sels[k].arg[1])){
+            printf("%s: No such job\n",sels[k].arg);  //Named jobs must exist; %all and the states may well be empty
+            status = 1;
+        }
+    }
+    return status;
+}
+
+static void wait_done(struct job_t *job, int status)
+{
+    *(int *)job->data = status;
+}
+
+/* 
+ * do_wait - Execute the builtin wait command: wait for the given
+ *     background jobs (PIDs or %jobids) to finish, or for all of them,
+ *     including those still queued.
+ *     Returns the exit status of the last one given, if it can tell.
+ *     ctrl-c stops waiting.
+ */
+int do_wait(char **argv)
+{
+    struct job_t *job;
+    int i, jid, status = 0, ended = -1;
+
+    if(client!=NULL){  //The server can't block on one client: it answers once the jobs are over
+        return srv_wait(argv);
+    }
+    waiting = 1;
+    if(argv[1]==NULL){
+        while(waiting){
+            for(job=jobs.head;job!=NULL && job->state!=BG && job->state!=QU;job=job->next)
+                ;
+            if(job==NULL){
+                break;
+            }
+            ev_wait(-1);
+        }
+    }
+    for(i=1;waiting && argv[i]!=NULL;i++){
+        job = argv[i][0]=='%' ? getjobjid(&jobs,atoi(argv[i]+1)) : getjobpid(&jobs,atoi(argv[i]));
+        if(job==NULL){
+            if((status=takeended(&jobs,argv[i][0]=='%' ? atoi(argv[i]+1) : 0,atoi(argv[i])))<0){  //Over before we got to wait for it?
+                printf("wait: %s: No such job\n",argv[i]);
+                status = 127;
+            }
+            continue;
+        }
+        status = 0;
+        if(job->done==NULL){  //Find out how it ends
+            ended = -1;
+            job->done = wait_done;
+            job->data = &ended;
+        }
+        jid = job->jid;
+        while(waiting && (job=getjobjid(&jobs,jid))!=NULL && (job->state==BG || job->state==QU)){
+            ev_wait(-1);
+        }
+        if(job!=NULL && job->done==wait_done){  //Still around, stopped or interrupted
+            job->done = NULL;
+            job->data = NULL;
+        }
+        if(ended!=-1){
+            status = WIFEXITED(ended) ? WEXITSTATUS(ended) : 128+WTERMSIG(ended);
+            ended = -1;
+        }
+    }
+    if(!waiting){
+        return 130;  //interrupted by ctrl-c
+    }
+    waiting = 0;
+    return status;
+}
+
+/* 
+ * do_output - Execute the builtin output command: show the captured
+ *     output of a background job (PID or %jobid). With -f, keep
+ *     showing it as it comes, until the job is over or ctrl-c.
+ */
+int do_output(char **argv)
+{
+    struct job_t *job;
+    int follow = 0, jid;
+
+    if(argv[1]!=NULL && strcmp(argv[1],"-f")==0){
+        follow = 1;
+        argv++;
+    }
+    if(argv[1]==NULL || argv[2]!=NULL){
+        printf("usage: output [-f] <pid|%%jobid>\n");
+        return 2;
+    }
+    job = argv[1][0]=='%' ? getjobjid(&jobs,atoi(argv[1]+1)) : getjobpid(&jobs,atoi(argv[1]));
+    if(job==NULL){
+        printf("output: %s: No such job\n",argv[1]);
+        return 1;
+    }
+    if(job->out==NULL){
+        printf("output: %s: Output not captured\n",argv[1]);
+        return 1;
+    }
+    ob_read(job->out);
+    ob_show(job->out,0);
+    if(!follow){
+        return 0;
+    }
+
+    //Whatever is left when it ends is shown by chld_drain, just before the job goes away
+    jid = job->jid;
+    waiting = 1;
+    while(waiting && (job=getjobjid(&jobs,jid))!=NULL){
+        ob_show(job->out,job->out->printed);
+        ev_wait(-1);
+    }
+    if(!waiting){
+        return 130;  //interrupted by ctrl-c
+    }
+    waiting = 0;
+    return 0;
+}
+
+/* 
+ * do_true, do_false - Execute the builtin true and false commands
+ */
+int do_true(char **argv)
+{
+    return 0;
+}
+
+int do_false(char **argv)
+{
+    return 1;
+}
+
+/* 
+ * do_stats - Execute the builtin stats command: print how long each
+ *     phase of command handling took since the last stats, then start
+ *     over. With -v, also print the histograms.
+ */
+int do_stats(char **argv)
+{
+    int verbose = argv[1]!=NULL && strcmp(argv[1],"-v")==0;
+
+    if(argv[1]!=NULL && (!verbose || argv[2]!=NULL)){
+        printf("usage: stats [-v]\n");
+        return 2;
+    }
+    ph_print(verbose);
+    ph_reset();
+    return 0;
+}
+
+/* 
+ * waitfg - Block until process pid is no longer the foreground process
+ */
+void waitfg(pid_t pid)
+{
+    long long t0 = ph_now();  //A SIGCHLD read before this didn't end our wait
+
+    if(jobs.fg!=NULL){
+        tty_give(jobs.fg);  //Keyboard signals now go straight to the job
+    }
+    //The job is freed once it is reaped, so look it up again after every wakeup
+    while(fgpid(&jobs) == pid){   //If such a job exists and running in foreground
+        if(jobs.fg->out!=NULL && jobs.fg->out->printed<jobs.fg->out->total){
+            ob_show(jobs.fg->out,jobs.fg->out->printed);  //A captured job brought to the foreground shows its output as it comes
+        }
+        ev_wait(-1);  //Run the event loop until sigchld_handler has changed the job's state, then check again
+    }
+    tty_take(getjobpid(&jobs,pid));  //Back to us, keeping the modes of a stopped job for when it resumes
+    if(chldat>t0){
+        ph_add(PH_WAKE,ph_now()-chldat);  //Only a SIGCHLD ends the wait
+    }
+    chldat=0;  //Used up, so the next wait doesn't count it again
+
+    return;
+}
+
+/*****************
+ * Signal handlers
+ *
+ * SIGCHLD, SIGINT and SIGTSTP are blocked and read from a signalfd,
+ * so these run synchronously from the event loop, never
+ * asynchronously in the middle of other shell code.
+ *****************/
+
+/* 
+ * sigchld_handler - The kernel sends a SIGCHLD to the shell whenever
+ *     a child job terminates (becomes a zombie), or stops because it
+ *     received a SIGSTOP or SIGTSTP signal. The handler only reaps the
+ *     waiting children and queues what happened to them on chldring,
+ *     up to CHLDRING of them at a time; chld_drain then updates the job
+ *     list and prints the messages for the whole batch. Several pending
+ *     SIGCHLDs are coalesced into a single call.
+ *
+ * The ring has a single producer and a single consumer, each owning
+ * its index, so neither side ever waits for the other.
+ */
+void sigchld_handler(int sig) 
+{
+    struct chldev_t *ev;
+    pid_t pid;
+
+    //Checking for any process which is terminated, along with the resources it used
+    while(chldhead-chldtail < CHLDRING){
+        ev = &chldring[chldhead & (CHLDRING-1)];
+        if((pid = wait4(-1,&ev->status,WNOHANG|WUNTRACED|WCONTINUED,&ev->ru))<=0){
+            break;
+        }
+        ev->pid = pid;
+        chldhead++;
+    }
+    return;
+}
+
+/* 
+ * chld_drain - Apply the child state changes queued by sigchld_handler
+ *     to the job list, reporting stopped and killed jobs
+ */
+void chld_drain(void)
+{
+    struct chldev_t *ev;
+    int status;
+    pid_t pid;
+    struct proc_t *procPtr, *p;
+    struct job_t *jobsPtr;
+
+    for(;chldtail!=chldhead;chldtail++){
+        ev = &chldring[chldtail & (CHLDRING-1)];
+        pid = ev->pid;
+        status = ev->status;
+        procPtr = getproc(&jobs,pid);  //geting the pipeline stage with that pid
+        if(procPtr==NULL){  //not one of our jobs (e.g. the zygote)
+            continue;
+        }
+        jobsPtr = procPtr->job;
+
+        //Continued by a SIGCONT, from bg or fg or someone else. A stopped job is now running in the background.
+        if(WIFCONTINUED(status)){
+            if(jobsPtr->state == ST){
+                setjobstate(&jobs,jobsPtr,BG);
+            }
+            es_begin("continued",jobsPtr);
+            es_printf(",\"pid\":%d",pid);
+            es_end();
+            continue;
+        }
+
+        //If is stopped by the signal, then print which signal stopped it and change its state to ST, do not delete it.
+        //Only the first stage of a pipeline to stop is reported.
+        if(WIFSTOPPED(status)){
+            es_begin("stopped",jobsPtr);
+            es_printf(",\"pid\":%d,\"signal\":%d",pid,WSTOPSIG(status));
+            es_end();
+            if(jobsPtr->state != ST){
+                printf("Job [%d] (%d) stopped by signal %d\n",jobsPtr->jid,jobsPtr->pid,WSTOPSIG(status));
+                if(jobsPtr->state==FG){
+                    laststatus = 128+WSTOPSIG(status);
+                }
+                setjobstate(&jobs,jobsPtr,ST);
+            }
+            continue;
+        }
+
+        //It exited or was terminated by a signal. The job is over once all stages of its pipeline are.
+        procPtr->done = 1;
+        procPtr->status = status;
+        closepidfd(&jobs,procPtr);  //Its PID is free for reuse now, and nothing can be signaled through it anymore
+        timeradd(&jobsPtr->ru.ru_utime,&ev->ru.ru_utime,&jobsPtr->ru.ru_utime);
+        timeradd(&jobsPtr->ru.ru_stime,&ev->ru.ru_stime,&jobsPtr->ru.ru_stime);
+        if(ev->ru.ru_maxrss > jobsPtr->ru.ru_maxrss){
+            jobsPtr->ru.ru_maxrss = ev->ru.ru_maxrss;
+        }
+        jobsPtr->ru.ru_nvcsw += ev->ru.ru_nvcsw;
+        jobsPtr->ru.ru_nivcsw += ev->ru.ru_nivcsw;
+        if(--jobsPtr->nlive > 0){
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC,&jobsPtr->end);
+        if(jobsPtr->out!=NULL){  //Print what it left in its capture buffer, before anything about how it ended
+            ob_read(jobsPtr->out);
+            ob_show(jobsPtr->out,jobsPtr->out->printed);
+        }
+
+        //Like the exit status, the fate of a pipeline is that of its last stage (earlier ones typically die of SIGPIPE).
+        //If it terminated due to signal, then print which signal terminated it and then remove its job-table entry.
+        for(p=jobsPtr->procs;p->next!=NULL;p=p->next)
+            ;
+        status = p->status;
+        if(WIFSIGNALED(status)){
+            printf("Job [%d] (%d) terminated by signal %d\n",jobsPtr->jid,jobsPtr->pid,WTERMSIG(status));
+        }
+        es_begin(WIFSIGNALED(status)?"signaled":"exited",jobsPtr);
+        es_printf(WIFSIGNALED(status)?",\"pid\":%d,\"signal\":%d":",\"pid\":%d,\"status\":%d",
+                  p->pid,WIFSIGNALED(status)?WTERMSIG(status):WEXITSTATUS(status));
+        es_printf(",\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,\"maxrss\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld",
+                  (jobsPtr->end.tv_sec-jobsPtr->start.tv_sec)+(jobsPtr->end.tv_nsec-jobsPtr->start.tv_nsec)/1e9,
+                  jobsPtr->ru.ru_utime.tv_sec+jobsPtr->ru.ru_utime.tv_usec/1e6,
+                  jobsPtr->ru.ru_stime.tv_sec+jobsPtr->ru.ru_stime.tv_usec/1e6,
+                  jobsPtr->ru.ru_maxrss,jobsPtr->ru.ru_nvcsw,jobsPtr->ru.ru_nivcsw);
+        es_end();
+        if(jobsPtr->state==FG){
+            laststatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128+WTERMSIG(status);
+        }
+        if(jobsPtr->done!=NULL){  //Let whoever started the job know how it ended
+            jobsPtr->done(jobsPtr,status);
+        }
+        else if(jobsPtr->state==BG){  //Or keep it for a wait still to come
+            addended(&jobs,jobsPtr,status);
+        }
+        deletejob(&jobs,pid);
+    }
+    if(qlen>0){
+        qadmit();  //Finished jobs may make room for queued ones
+    }
+    if(clients!=NULL && !busy){
+        srv_run();  //Clients may be waiting for these jobs
+    }
+    return;
+}
+
+/* 
+ * sigint_handler - The kernel sends a SIGINT to the shell whenver the
+ *    user types ctrl-c at the keyboard.  Read it from the signalfd and
+ *    send it along to the foreground job.  
+ */
+void sigint_handler(int sig) 
+{
+    //Check if any job is running in forground
+    if(jobs.fg!=NULL){
+        signaljob(jobs.fg,SIGINT); //If so then send SIGINT signal to the process group of that job
+    }
+    else if(prun!=NULL){
+        prun_signal(SIGINT); //The items of a parallel run are the foreground work
+    }
+    else if(waiting){
+        waiting = 0; //Interrupt the wait builtin
+    }
+    interrupted = 1; //No more iterations of the loops of the command line
+
+    return;
+}
+
+/*
+ * sigtstp_handler - The kernel sends a SIGTSTP to the shell whenever
+ *     the user types ctrl-z at the keyboard. Read it from the signalfd
+ *     and suspend the foreground job by sending it a SIGTSTP.  
+ */
+void sigtstp_handler(int sig) 
+{
+    //Check if any job is running in forground
+    if(jobs.fg!=NULL){
+        signaljob(jobs.fg,SIGTSTP); //If so then send SIGTSTP signal to the process group of that job
+    }
+    else if(prun!=NULL){
+        prun_signal(SIGTSTP); //The items of a parallel run are the foreground work
+    }
+
+    return;
+}
+
+/*********************
+ * End signal handlers
+ *********************/
+
+/***********************************************
+ * Helper routines that manipulate the job list
+ **********************************************/
+
+/*
+ * The job list keeps every job on a doubly linked list in increasing
+ * JID order, plus two chained hash tables: one indexing the processes
+ * of all jobs by PID, the other indexing jobs by JID. Since a new job
+ * always gets the largest JID so far, adding a job appends to the list
+ * and the largest JID is simply the tail's. The hash tables double in
+ * size when they are full, so all lookups, additions and deletions
+ * take constant time (per process).
+ *
+ * A reaped process stays hashed until its job is deleted. Should its
+ * PID be reused by a newer job meanwhile, the newer process is found
+ * first since processes are inserted at the head of their bucket.
+ */
+
+/* clearjob - Clear the entries in a job struct, releasing its processes
+ *     and captured output */
+void clearjob(struct job_t *job) {
+    struct proc_t *p;
+
+    while ((p = job->procs) != NULL) {
+	job->procs = p->next;
+	closepidfd(&jobs, p);
+	free(p);
+    }
+    if (job->out != NULL) {
+	ob_close(job->out);
+	job->out = NULL;
+    }
+    job->pid = 0;
+    job->jid = 0;
+    job->state = UNDEF;
+    job->nlive = 0;
+    free(job->cmdline);
+    job->cmdline = NULL;
+    job->jidnext = NULL;
+    job->prev = job->next = NULL;
+}
+
+/* initjobs - Initialize the job list */
+void initjobs(struct jobtab_t *jobs) {
+    struct rlimit rl;
+
+    jobs->head = jobs->tail = NULL;
+    jobs->nbuckets = JOBHASH0;
+    jobs->njobs = 0;
+    jobs->nprocs = 0;
+    jobs->npidfds = 0;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+	rl.rlim_cur = 1024;
+    if (rl.rlim_cur == RLIM_INFINITY)
+	jobs->maxpidfds = SIZE_MAX;
+    else  /* with a low limit, pidfds get at most half */
+	jobs->maxpidfds = rl.rlim_cur > 2 * FDRESERVE ? rl.rlim_cur - FDRESERVE : rl.rlim_cur / 2;
+    jobs->fg = NULL;
+    memset(jobs->ended, 0, sizeof(jobs->ended));
+    jobs->nended = 0;
+    jobs->pidhash = calloc(jobs->nbuckets, sizeof(struct proc_t *));
+    jobs->jidhash = calloc(jobs->nbuckets, sizeof(struct job_t *));
+    if (jobs->pidhash == NULL || jobs->jidhash == NULL)
+	unix_error("calloc error");
+}
+
+/* hashproc - Insert a process into the PID hash table */
+static void hashproc(struct jobtab_t *jobs, struct proc_t *p)
+{
+    size_t mask = jobs->nbuckets - 1;
+
+    p->pidnext = jobs->pidhash[p->pid & mask];
+    jobs->pidhash[p->pid & mask] = p;
+}
+
+/* hashjob - Insert a job into the JID hash table */
+static void hashjob(struct jobtab_t *jobs, struct job_t *job)
+{
+    size_t mask = jobs->nbuckets - 1;
+
+    job->jidnext = jobs->jidhash[job->jid & mask];
+    jobs->jidhash[job->jid & mask] = job;
+}
+
+/* 
+ * growjobs - Double the number of hash buckets and rehash all jobs
+ *     and processes. Going through the list in JID order keeps newer
+ *     processes ahead of older ones with the same PID.
+ */
+static void growjobs(struct jobtab_t *jobs)
+{
+    struct proc_t **pidhash, *p;
+    struct job_t **jidhash, *job;
+    size_t n = jobs->nbuckets * 2;
+
+    pidhash = calloc(n, sizeof(struct proc_t *));
+    jidhash = calloc(n, sizeof(struct job_t *));
+    if (pidhash == NULL || jidhash == NULL) {
+	free(pidhash);
+	free(jidhash);
+	return; /* keep the longer chains */
+    }
+    free(jobs->pidhash);
+    free(jobs->jidhash);
+    jobs->pidhash = pidhash;
+    jobs->jidhash = jidhash;
+    jobs->nbuckets = n;
+    for (job = jobs->head; job != NULL; job = job->next) {
+	hashjob(jobs, job);
+	for (p = job->procs; p != NULL; p = p->next)
+	    hashproc(jobs, p);
+    }
+}
+
+/* maxjid - Returns largest allocated job ID */
+int maxjid(struct jobtab_t *jobs) 
+{
+    return jobs->tail != NULL ? jobs->tail->jid : 0;
+}
+
+/* linkproc - Append process p to the end of a job's pipeline */
+static void linkproc(struct jobtab_t *jobs, struct job_t *job, struct proc_t *p)
+{
+    struct proc_t **pp;
+
+    /* Grow first: growjobs() rehashes the processes already linked in */
+    if (++jobs->nprocs > jobs->nbuckets)
+	growjobs(jobs);
+
+    p->job = job;
+    p->pidfd = -1;
+    for (pp = &job->procs; *pp != NULL; pp = &(*pp)->next)
+	;
+    *pp = p;
+
+    /* Pin it against PID reuse, as long as that leaves FDRESERVE
+     * descriptors free; leaders come first, as jobs are signaled
+     * through them, so other stages only take the first half */
+    if (jobs->npidfds < (pp == &job->procs ? jobs->maxpidfds : jobs->maxpidfds / 2) &&
+	(p->pidfd = syscall(SYS_pidfd_open, p->pid, 0)) >= 0)
+	jobs->npidfds++;
+    job->nlive++;
+    hashproc(jobs, p);
+}
+
+/* closepidfd - Let go of a process's pidfd, if it has one */
+void closepidfd(struct jobtab_t *jobs, struct proc_t *p)
+{
+    if (p->pidfd >= 0) {
+	close(p->pidfd);
+	p->pidfd = -1;
+	jobs->npidfds--;
+    }
+}
+
+/* addended - Keep the status of a background job that ended, in place
+ *     of the oldest one kept */
+void addended(struct jobtab_t *jobs, struct job_t *job, int status)
+{
+    struct endjob_t *e = &jobs->ended[jobs->nended++ % ENDJOBS];
+
+    e->jid = job->jid;
+    e->pid = job->pid;
+    e->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/* takeended - Forget the ended job with JID jid (or else PID pid) and
+ *     return its status, or -1 if none is kept */
+int takeended(struct jobtab_t *jobs, int jid, pid_t pid)
+{
+    struct endjob_t *e;
+
+    for (e = jobs->ended; e < jobs->ended + ENDJOBS; e++) {
+	if (e->jid != 0 && (jid > 0 ? e->jid == jid : e->pid == pid)) {
+	    e->jid = 0;
+	    return e->status;
+	}
+    }
+    return -1;
+}
+
+/* addjob - Add a job to the job list, with pid as its first process (none for a QU job) */
+int addjob(struct jobtab_t *jobs, pid_t pid, int state, char *cmdline) 
+{
+    struct job_t *job;
+    struct proc_t *p = NULL;
+    long long t0 = ph_now();
+    
+    if (pid < 1 && state != QU)
+	return 0;
+
+    if ((job = calloc(1, sizeof(*job))) == NULL ||
+	(job->cmdline = strdup(cmdline)) == NULL ||
+	(state != QU && (p = calloc(1, sizeof(*p))) == NULL)) {
+	if (job != NULL)
+	    free(job->cmdline);
+	free(job);
+	printf("Tried to create too many jobs\n");
+	return 0;
+    }
+    job->pid = pid;
+    job->state = state;
+    job->jid = maxjid(jobs) + 1;
+    takeended(jobs, job->jid, 0);  /* %jid means this job from now on */
+    clock_gettime(CLOCK_MONOTONIC, &job->start);
+
+    /* Grow first: growjobs() rehashes the jobs already on the list */
+    if (++jobs->njobs > jobs->nbuckets)
+	growjobs(jobs);
+
+    job->prev = jobs->tail;
+    if (jobs->tail != NULL)
+	jobs->tail->next = job;
+    else
+	jobs->head = job;
+    jobs->tail = job;
+    hashjob(jobs, job);
+    if (state == FG)
+	jobs->fg = job;
+    jobs->nrunning += state == BG;
+    if (p != NULL) {
+	p->pid = pid;
+	linkproc(jobs, job, p);
+    }
+
+    ph_add(PH_ADDJOB, ph_now() - t0);
+    if(verbose){
+	printf("Added job [%d] %d %s\n", job->jid, job->pid, job->cmdline);
+    }
+    return 1;
+}
+
+/* addproc - Add process pid to the end of a job's pipeline */
+int addproc(struct jobtab_t *jobs, struct job_t *job, pid_t pid)
+{
+    struct proc_t *p;
+
+    if (pid < 1 || (p = calloc(1, sizeof(*p))) == NULL)
+	return 0;
+    p->pid = pid;
+    linkproc(jobs, job, p);
+    return 1;
+}
+
+/* deletejob - Delete the job that process PID=pid belongs to from the job list */
+int deletejob(struct jobtab_t *jobs, pid_t pid) 
+{
+    struct job_t *job;
+    long long t0 = ph_now();
+
+    if ((job = getjobpid(jobs, pid)) == NULL)
+	return 0;
+    removejob(jobs, job);
+    ph_add(PH_DELJOB, ph_now() - t0);
+    return 1;
+}
+
+/* removejob - Delete a job from the job list */
+void removejob(struct jobtab_t *jobs, struct job_t *job)
+{
+    struct job_t **jp;
+    struct proc_t *p, **pp;
+    size_t mask = jobs->nbuckets - 1;
+
+    for (p = job->procs; p != NULL; p = p->next) {
+	for (pp = &jobs->pidhash[p->pid & mask]; *pp != p; pp = &(*pp)->pidnext)
+	    ;
+	*pp = p->pidnext;
+	jobs->nprocs--;
+    }
+    for (jp = &jobs->jidhash[job->jid & mask]; *jp != job; jp = &(*jp)->jidnext)
+	;
+    *jp = job->jidnext;
+    if (job->prev != NULL)
+	job->prev->next = job->next;
+    else
+	jobs->head = job->next;
+    if (job->next != NULL)
+	job->next->prev = job->prev;
+    else
+	jobs->tail = job->prev;
+    if (jobs->fg == job)
+	jobs->fg = NULL;
+    jobs->nrunning -= job->state == BG;
+    jobs->njobs--;
+
+    clearjob(job);
+    free(job);
+}
+
+/* setjobstate - Change the state of a job, tracking the foreground job */
+void setjobstate(struct jobtab_t *jobs, struct job_t *job, int state)
+{
+    if (jobs->fg == job && state != FG)
+	jobs->fg = NULL;
+    jobs->nrunning += (state == BG) - (job->state == BG);
+    job->state = state;
+    if (state == FG)
+	jobs->fg = job;
+}
+
+/* fgpid - Return PID of current foreground job, 0 if no such job */
+pid_t fgpid(struct jobtab_t *jobs) {
+    return jobs->fg != NULL ? jobs->fg->pid : 0;
+}
+
+/* getproc - Find a process (by PID) of any job on the job list */
+struct proc_t *getproc(struct jobtab_t *jobs, pid_t pid) {
+    struct proc_t *p = NULL;
+    long long t0 = ph_now();
+
+    if (pid >= 1)
+	for (p = jobs->pidhash[pid & (jobs->nbuckets - 1)]; p != NULL; p = p->pidnext)
+	    if (p->pid == pid)
+		break;
+    ph_add(PH_LOOKUP, ph_now() - t0);
+    return p;
+}
+
+/* getjobpid  - Find a job (by the PID of any of its processes) on the job list */
+struct job_t *getjobpid(struct jobtab_t *jobs, pid_t pid) {
+    struct proc_t *p = getproc(jobs, pid);
+
+    return p != NULL ? p->job : NULL;
+}
+
+/* getjobjid  - Find a job (by JID) on the job list */
+struct job_t *getjobjid(struct jobtab_t *jobs, int jid) 
+{
+    struct job_t *job = NULL;
+    long long t0 = ph_now();
+
+    if (jid >= 1)
+	for (job = jobs->jidhash[jid & (jobs->nbuckets - 1)]; job != NULL; job = job->jidnext)
+	    if (job->jid == jid)
+		break;
+    ph_add(PH_LOOKUP, ph_now() - t0);
+    return job;
+}
+
+/* 
+ * signaljob - Send sig to the process group of a job. While its leader
+ *     runs, this goes through the leader's pidfd, so it can't reach a
+ *     newer process that reused its PID. Once the leader is gone, the
+ *     group is signaled by ID: its other processes still hold on to
+ *     that ID, so it can't have been reused either. Returns 0, or -1
+ *     with errno set.
+ */
+int signaljob(struct job_t *job, int sig)
+{
+    static int pgflag = 1;  /* the kernel has PIDFD_SIGNAL_PROCESS_GROUP */
+    struct proc_t *p = job->procs;
+
+    if (p == NULL) {
+	errno = ESRCH;
+	return -1;
+    }
+    if (pgflag && p->pidfd >= 0 && !p->done) {
+	if (syscall(SYS_pidfd_send_signal, p->pidfd, sig, NULL, PIDFD_SIGNAL_PROCESS_GROUP) == 0)
+	    return 0;
+	if (errno != EINVAL)
+	    return -1;
+	pgflag = 0;
+    }
+    return kill(-job->pid, sig);
+}
+
+/* signalproc - Send sig to process pid, through its pidfd if it is one
+ *     of our running jobs */
+int signalproc(pid_t pid, int sig)
+{
+    struct proc_t *p = getproc(&jobs, pid);
+
+    if (p != NULL && p->pidfd >= 0 && !p->done)
+	return syscall(SYS_pidfd_send_signal, p->pidfd, sig, NULL, 0);
+    return kill(pid, sig);
+}
+
+/* pid2jid - Map process ID to job ID */
+int pid2jid(pid_t pid) 
+{
+    struct job_t *job = getjobpid(&jobs, pid);
+
+    return job != NULL ? job->jid : 0;
+}
+
+/* 
+ * printjob - Print a job of the job list. With lflag, also print its
+ *     elapsed time and the resources used by its finished processes.
+ */
+void printjob(struct job_t *job, int lflag)
+{
+    struct timespec now;
+    double real;
+
+    printf("[%d] (%d) ", job->jid, job->pid);
+    switch (job->state) {
+	case BG: 
+	    printf("Running ");
+	    break;
+	case FG: 
+	    printf("Foreground ");
+	    break;
+	case ST: 
+	    printf("Stopped ");
+	    break;
+	case QU: 
+	    printf("Queued ");
+	    break;
+    default:
+	    printf("listjobs: Internal error: job[%d].state=%d ", 
+		   job->jid, job->state);
+    }
+    if (lflag) {
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	real = (now.tv_sec - job->start.tv_sec) + (now.tv_nsec - job->start.tv_nsec) / 1e9;
+	printf("real=%.3fs user=%.3fs sys=%.3fs maxrss=%ldKB csw=%ld/%ld ", real,
+	       job->ru.ru_utime.tv_sec + job->ru.ru_utime.tv_usec / 1e6,
+	       job->ru.ru_stime.tv_sec + job->ru.ru_stime.tv_usec / 1e6,
+	       job->ru.ru_maxrss, job->ru.ru_nvcsw, job->ru.ru_nivcsw);
+	printplace(&job->place);
+    }
+    printf("%s", job->cmdline);
+}
+
+/* listjobs - Print the job list */
+void listjobs(struct jobtab_t *jobs) 
+{
+    struct job_t *job;
+    
+    for (job = jobs->head; job != NULL; job = job->next)
+	printjob(job, 0);
+}
+/******************************
+ * end job list helper routines
+ ******************************/
+
+
+/*****************************
+ * PATH lookup cache routines
+ *
+ * Commands are looked up in PATH once and their location is cached,
+ * so launching them again is a single execv() instead of one failed
+ * execve() per PATH directory. The cache is emptied whenever PATH
+ * changes; an entry whose file has gone is noticed when its execv()
+ * fails, dropped, and looked up again.
+ *****************************/
+
+/* strhash - FNV-1a hash of a string */
+unsigned long strhash(const char *str)
+{
+    unsigned long h = 2166136261UL;
+
+    while (*str)
+	h = (h ^ (unsigned char)*str++) * 16777619UL;
+    return h;
+}
+
+/* hashclear - Empty the PATH lookup cache */
+void hashclear(void)
+{
+    struct pathent_t *e;
+    int i;
+
+    for (i = 0; i < PATHHASH; i++) {
+	while ((e = pathhash[i]) != NULL) {
+	    pathhash[i] = e->next;
+	    free(e->name);
+	    free(e->path);
+	    free(e);
+	}
+    }
+}
+
+/* hashdrop - Remove a command from the PATH lookup cache */
+void hashdrop(const char *name)
+{
+    struct pathent_t *e, **ep;
+
+    for (ep = &pathhash[strhash(name) % PATHHASH]; (e = *ep) != NULL; ep = &e->next) {
+	if (strcmp(e->name, name) == 0) {
+	    *ep = e->next;
+	    free(e->name);
+	    free(e->path);
+	    free(e);
+	    return;
+	}
+    }
+}
+
+/* 
+ * hashfind - Return the location of an executable named name in PATH,
+ *     or NULL if there is none. Found locations in absolute PATH
+ *     directories are cached; the returned string belongs to the cache.
+ */
+char *hashfind(const char *name)
+{
+    static char *found = NULL;  /* last uncached result */
+    struct pathent_t *e, **bucket;
+    const char *path = getenv("PATH"), *dir, *end;
+    struct stat st;
+    size_t dlen, nlen = strlen(name);
+    char *file;
+
+    if (path == NULL)
+	path = "/bin:/usr/bin";
+    if (pathcached == NULL || strcmp(pathcached, path) != 0) {
+	hashclear();
+	free(pathcached);
+	pathcached = strdup(path);
+    }
+
+    bucket = &pathhash[strhash(name) % PATHHASH];
+    for (e = *bucket; e != NULL; e = e->next)
+	if (strcmp(e->name, name) == 0)
+	    return e->path;
+
+    for (dir = path; ; dir = end + 1) {
+	end = strchrnul(dir, ':');
+	dlen = end - dir;
+	if ((file = malloc(dlen + nlen + 3)) == NULL)
+	    return NULL;
+	if (dlen == 0)          /* empty entry means the current directory */
+	    strcpy(file, ".");
+	else {
+	    memcpy(file, dir, dlen);
+	    file[dlen] = '\0';
+	}
+	strcat(file, "/");
+	strcat(file, name);
+
+	if (stat(file, &st) == 0 && S_ISREG(st.st_mode) && access(file, X_OK) == 0) {
+	    if (file[0] != '/') {  /* relative to the cwd, which may change */
+		free(found);
+		return found = file;
+	    }
+	    if ((e = malloc(sizeof(*e))) == NULL || (e->name = strdup(name)) == NULL) {
+		free(e);
+		free(found);
+		return found = file;
+	    }
+	    e->path = file;
+	    e->next = *bucket;
+	    *bucket = e;
+	    return file;
+	}
+	free(file);
+	if (*end == '\0')
+	    return NULL;
+    }
+}
+/********************************
+ * End PATH lookup cache routines
+ ********************************/
+
+/*******************************
+ * Pathname expansion routines
+ *
+ * A word with an unquoted *, ? or [...] is a pattern, and parseline()
+ * replaces it with the sorted pathnames that match it. globpat()
+ * rewrites its source text with the quoted characters escaped by a
+ * backslash. Each component of the pattern that has wildcards is
+ * compiled once into a list of elements (struct gtok_t) and matched
+ * against every entry of its directory without backtracking beyond
+ * the last *. Directories are read with getdents64() in large batches,
+ * and their sorted listings are cached by device, inode and mtime for
+ * a few seconds, so that a script expanding patterns over the same
+ * big directories doesn't read them again. A directory changed within
+ * the last couple of seconds isn't cached, since a second change could
+ * leave its mtime as it was.
+ *******************************/
+
+/* 
+ * globpat - Return the pattern written as len bytes of source text at
+ *     src: quotes are removed, and characters that were quoted or
+ *     escaped are preceded by a backslash, so that they match only
+ *     themselves
+ */
+char *globpat(const char *src, size_t len)
+{
+    char *pat = arena_alloc(2 * len + 1), *p = pat;
+    const char *end = src + len;
+
+    while (src < end) {
+	if (*src == '\'') {
+	    for (src++; *src != '\''; src++) {
+		if (strchr("*?[]\\", *src) != NULL)
+		    *p++ = '\\';
+		*p++ = *src;
+	    }
+	    src++;
+	}
+	else if (*src == '"') {
+	    for (src++; *src != '"'; src++) {
+		if (*src == '\\' && strchr("\\\"$`", src[1]) != NULL)
+		    src++;
+		if (strchr("*?[]\\", *src) != NULL)
+		    *p++ = '\\';
+		*p++ = *src;
+	    }
+	    src++;
+	}
+	else if (*src == '\\') {
+	    if (src + 1 < end && src[1] != '\n')
+		src++;
+	    *p++ = '\\';
+	    *p++ = *src++;
+	}
+	else
+	    *p++ = *src++;
+    }
+    *p = '\0';
+    return pat;
+}
+
+/* bracket - Return the ] that closes the bracket expression starting
+ *     after a [ at p, or NULL if there is none (the [ is literal) */
+static const char *bracket(const char *p)
+{
+    const char *q;
+
+    if (*p == '!' || *p == '^')
+	p++;
+    if (*p == ']')
+	p++;
+    while (*p != '\0' && *p != ']' && *p != '/') {
+	if (p[0] == '[' && p[1] == ':' && (q = strstr(p + 2, ":]")) != NULL)
+	    p = q + 2;
+	else
+	    p += (p[0] == '\\' && p[1] != '\0') + 1;
+    }
+    return *p == ']' ? p : NULL;
+}
+
+/* globmeta - Return true if a pattern has any wildcard */
+static int globmeta(const char *p)
+{
+    for (; *p != '\0'; p++) {
+	if (*p == '\\' && p[1] != '\0')
+	    p++;
+	else if (*p == '*' || *p == '?' || (*p == '[' && bracket(p + 1) != NULL))
+	    return 1;
+    }
+    return 0;
+}
+
+/* 
+ * globcomp - Compile a pattern component into *ntoks elements. Bracket
+ *     expressions take ranges, ! or ^ for the complement, and the
+ *     classes [:alpha:], [:digit:] and so on.
+ */
+static struct gtok_t *globcomp(const char *p, int *ntoks)
+{
+    static const struct { char *name; int (*is)(int); } classes[] = {
+	{ "alnum", isalnum }, { "alpha", isalpha }, { "blank", isblank },
+	{ "cntrl", iscntrl }, { "digit", isdigit }, { "graph", isgraph },
+	{ "lower", islower }, { "print", isprint }, { "punct", ispunct },
+	{ "space", isspace }, { "upper", isupper }, { "xdigit", isxdigit },
+    };
+    struct gtok_t *toks = arena_alloc((strlen(p) + 1) * sizeof(*toks)), *t;
+    const char *end, *q;
+    int n = 0, neg, c, hi, i;
+    size_t k;
+
+    while (*p != '\0') {
+	t = &toks[n++];
+	t->op = GT_CHAR;
+	if (*p == '*') {
+	    t->op = GT_STAR;
+	    while (*p == '*')
+		p++;
+	    continue;
+	}
+	if (*p == '?') {
+	    t->op = GT_ANY;
+	    p++;
+	    continue;
+	}
+	if (*p == '[' && (end = bracket(p + 1)) != NULL) {
+	    t->op = GT_SET;
+	    t->set = memset(arena_alloc(32), 0, 32);
+	    p++;
+	    if ((neg = *p == '!' || *p == '^'))
+		p++;
+	    for (q = p; q < end; ) {
+		if (q[0] == '[' && q[1] == ':') {
+		    for (k = 0; k < sizeof(classes)/sizeof(classes[0]); k++)
+			if (strncmp(q + 2, classes[k].name, strlen(classes[k].name)) == 0 &&
+			    strncmp(q + 2 + strlen(classes[k].name), ":]", 2) == 0)
+			    break;
+		    if (k < sizeof(classes)/sizeof(classes[0])) {
+			for (i = 1; i < 256; i++)
+			    if (classes[k].is(i))
+				t->set[i >> 3] |= 1 << (i & 7);
+			q = strstr(q + 2, ":]") + 2;
+			continue;
+		    }
+		}
+		if (*q == '\\' && q + 1 < end)
+		    q++;
+		c = hi = (unsigned char)*q++;
+		if (q[0] == '-' && q + 1 < end) {  /* a range */
+		    q += 1 + (q[1] == '\\' && q + 2 < end);
+		    hi = (unsigned char)*q++;
+		}
+		for (i = c; i <= hi; i++)
+		    t->set[i >> 3] |= 1 << (i & 7);
+	    }
+	    if (neg)
+		for (i = 0; i < 32; i++)
+		    t->set[i] = ~t->set[i];
+	    p = end + 1;
+	    continue;
+	}
+	if (*p == '\\' && p[1] != '\0')
+	    p++;
+	t->c = (unsigned char)*p++;
+    }
+    *ntoks = n;
+    return toks;
+}
+
+/* 
+ * globmatch - Return true if name matches the compiled component. A *
+ *     first matches nothing and then one more character each time the
+ *     rest fails to match; only the last * needs to be retried.
+ */
+static int globmatch(struct gtok_t *toks, int ntoks, const char *name)
+{
+    const unsigned char *s = (const unsigned char *)name, *stars = NULL;
+    int i = 0, star = -1;
+
+    while (*s != '\0') {
+	if (i < ntoks && toks[i].op != GT_STAR &&
+	    (toks[i].op == GT_ANY ||
+	     (toks[i].op == GT_CHAR && toks[i].c == *s) ||
+	     (toks[i].op == GT_SET && (toks[i].set[*s >> 3] & 1 << (*s & 7))))) {
+	    i++;
+	    s++;
+	}
+	else if (i < ntoks && toks[i].op == GT_STAR) {
+	    star = i++;
+	    stars = s;
+	}
+	else if (star >= 0) {
+	    i = star + 1;
+	    s = ++stars;
+	}
+	else
+	    return 0;
+    }
+    while (i < ntoks && toks[i].op == GT_STAR)
+	i++;
+    return i == ntoks;
+}
+
+static int cmpname(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* dirfree - Free a directory listing */
+static void dirfree(struct dirlist_t *d)
+{
+    free(d->names);
+    free(d->data);
+    free(d);
+}
+
+/* dirdrop - Take a listing out of cache slot i, freeing it unless it is in use */
+static void dirdrop(int i)
+{
+    struct dirlist_t *d = dircache[i];
+
+    if (d == NULL)
+	return;
+    dircache[i] = NULL;
+    if (d->pins > 0)
+	d->evicted = 1;
+    else
+	dirfree(d);
+}
+
+/* dirrelease - Done with a listing returned by dirlist() */
+static void dirrelease(struct dirlist_t *d)
+{
+    if (--d->pins == 0 && d->evicted)
+	dirfree(d);
+}
+
+/* 
+ * dirread - Read all entries of directory fd but . and .., in batches
+ *     of up to DENTBUFSZ bytes, into a sorted listing
+ */
+static struct dirlist_t *dirread(int fd)
+{
+    struct dirlist_t *d;
+    struct dent64_t *de;
+    size_t used = 0, cap = 0, len;
+    long n, off;
+    int i;
+
+    if (dentbuf == NULL && (dentbuf = malloc(DENTBUFSZ)) == NULL)
+	return NULL;
+    if ((d = calloc(1, sizeof(*d))) == NULL)
+	return NULL;
+    while ((n = syscall(SYS_getdents64, fd, dentbuf, DENTBUFSZ)) > 0) {
+	for (off = 0; off < n; off += de->d_reclen) {
+	    de = (struct dent64_t *)(dentbuf + off);
+	    if (de->d_name[0] == '.' && (de->d_name[1] == '\0' ||
+					 (de->d_name[1] == '.' && de->d_name[2] == '\0')))
+		continue;
+	    len = strlen(de->d_name);
+	    if (used + len + 2 > cap) {
+		cap = cap ? 2 * cap : DENTBUFSZ;
+		if ((d->data = realloc(d->data, cap)) == NULL)
+		    unix_error("realloc error");
+	    }
+	    d->data[used++] = de->d_type;
+	    memcpy(d->data + used, de->d_name, len + 1);
+	    used += len + 1;
+	    d->nnames++;
+	}
+    }
+    if (n < 0 || (d->names = malloc((d->nnames + 1) * sizeof(char *))) == NULL) {
+	dirfree(d);
+	return NULL;
+    }
+    for (i = 0, off = 0; i < d->nnames; i++) {
+	d->names[i] = d->data + off + 1;
+	off += strlen(d->names[i]) + 2;
+    }
+    qsort(d->names, d->nnames, sizeof(char *), cmpname);
+    return d;
+}
+
+/* 
+ * dirlist - Return the sorted entries of a directory, from the cache
+ *     if it hasn't changed since, or NULL if it can't be read. Release
+ *     it with dirrelease().
+ */
+static struct dirlist_t *dirlist(const char *path)
+{
+    struct dirlist_t *d;
+    struct stat st;
+    struct timespec now, real;
+    int fd, i, slot = 0;
+
+    if ((fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+	return NULL;
+    if (fstat(fd, &st) < 0) {
+	close(fd);
+	return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (i = 0; i < DIRCACHE; i++) {
+	if ((d = dircache[i]) == NULL || d->dev != st.st_dev || d->ino != st.st_ino)
+	    continue;
+	if (now.tv_sec - d->when < DIRCACHETTL && d->mtime.tv_sec == st.st_mtim.tv_sec &&
+	    d->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+	    close(fd);
+	    d->pins++;
+	    return d;
+	}
+	dirdrop(i);  /* changed, or too old */
+    }
+
+    d = dirread(fd);
+    close(fd);
+    if (d == NULL)
+	return NULL;
+    d->dev = st.st_dev;
+    d->ino = st.st_ino;
+    d->mtime = st.st_mtim;
+    d->when = now.tv_sec;
+    d->pins = 1;
+    clock_gettime(CLOCK_REALTIME, &real);
+    if ((d->racy = real.tv_sec - st.st_mtim.tv_sec < 2)) {
+	d->evicted = 1;  /* used this once only */
+	return d;
+    }
+    for (i = 0; i < DIRCACHE; i++) {  /* a free slot, or else the oldest */
+	if (dircache[i] == NULL) {
+	    slot = i;
+	    break;
+	}
+	if (dircache[i]->when < dircache[slot]->when)
+	    slot = i;
+    }
+    dirdrop(slot);
+    dircache[slot] = d;
+    return d;
+}
+
+/* globadd - Add a pathname to the argv of an expansion */
+static void globadd(struct globctx_t *ctx, char *path)
+{
+    char **argv;
+
+    if (*ctx->argcp + ctx->reserve >= *ctx->capp) {
+	*ctx->capp = 2 * *ctx->capp + ctx->reserve;
+	argv = arena_alloc(*ctx->capp * sizeof(char *));
+	memcpy(argv, *ctx->argvp, *ctx->argcp * sizeof(char *));
+	*ctx->argvp = argv;
+    }
+    (*ctx->argvp)[(*ctx->argcp)++] = path;
+    ctx->n++;
+}
+
+/* 
+ * globwalk - Expand the components of pattern rest under the directory
+ *     path (of length len, "" for the current one)
+ */
+static void globwalk(struct globctx_t *ctx, char *path, size_t len, char *rest)
+{
+    struct dirlist_t *d;
+    struct gtok_t *toks;
+    struct stat st;
+    char *comp, *next, *name, *p, *q;
+    size_t clen, nlen;
+    int ntoks, i, more, type;
+
+    for (clen = 0; rest[clen] != '\0' && rest[clen] != '/'; clen++)
+	;
+    comp = strncpy(arena_alloc(clen + 1), rest, clen);
+    comp[clen] = '\0';
+    more = rest[clen] == '/';  /* what matches must be a directory */
+    for (next = rest + clen; *next == '/'; next++)
+	;
+
+    if (!globmeta(comp)) {  /* taken as it is, no need to read the directory */
+	p = q = arena_alloc(len + clen + 2);
+	memcpy(q, path, len);
+	for (q += len; *comp != '\0'; comp++) {
+	    if (*comp == '\\' && comp[1] != '\0')
+		comp++;
+	    *q++ = *comp;
+	}
+	if (more)
+	    *q++ = '/';
+	*q = '\0';
+	if (*next != '\0')
+	    globwalk(ctx, p, q - p, next);
+	else if (lstat(p, &st) == 0)
+	    globadd(ctx, p);
+	return;
+    }
+
+    if ((d = dirlist(len > 0 ? path : ".")) == NULL)
+	return;
+    toks = globcomp(comp, &ntoks);
+    for (i = 0; i < d->nnames; i++) {
+	name = d->names[i];
+	type = (unsigned char)name[-1];
+	if ((name[0] == '.' && comp[0] != '.') ||  /* hidden unless asked for */
+	    (more && type != DT_DIR && type != DT_LNK && type != DT_UNKNOWN) ||
+	    !globmatch(toks, ntoks, name))
+	    continue;
+	nlen = strlen(name);
+	p = arena_alloc(len + nlen + 2);
+	memcpy(p, path, len);
+	memcpy(p + len, name, nlen);
+	if (more)
+	    p[len + nlen++] = '/';
+	p[len + nlen] = '\0';
+	if (*next != '\0')
+	    globwalk(ctx, p, len + nlen, next);
+	else if (!more || type == DT_DIR || (stat(p, &st) == 0 && S_ISDIR(st.st_mode)))
+	    globadd(ctx, p);
+    }
+    dirrelease(d);
+}
+
+/* 
+ * globexpand - Add the pathnames matching pattern pat, in order, to the
+ *     argv of ctx. Returns how many there are: 0 if none matches, or if
+ *     pat has no wildcards after all.
+ */
+int globexpand(char *pat, struct globctx_t *ctx)
+{
+    ctx->n = 0;
+    if (!globmeta(pat))
+	return 0;
+    if (*pat == '/') {
+	while (*pat == '/')
+	    pat++;
+	globwalk(ctx, "/", 1, pat);
+    }
+    else
+	globwalk(ctx, "", 0, pat);
+    return ctx->n;
+}
+
+/***********************************
+ * End pathname expansion routines
+ ***********************************/
+
+/*************************
+ * Command tree routines
+ *
+ * eval() compiles a command line into a tree of commands: a list of
+ * pipelines and loops, each knowing from ; && or || when it runs.
+ * A pipeline keeps its text, and is parsed with parsecmd() the first
+ * time it runs; the parse is then copied out of the arena and reused
+ * as long as the tree lives. Only pipelines with patterns or loop
+ * variables, whose words may come out different every time, are
+ * parsed again for each run, from their text with the variables
+ * substituted. The trees of the last TREECACHE command lines are kept
+ * in a hash table by their text, with an LRU list to evict the oldest.
+ *
+ * A pipeline's text, with the variables substituted, is also the
+ * command line of the job it becomes. So jobs and the event stream
+ * show each job as the pipeline it runs, not as the whole line it
+ * came from, and a queued job can be parsed again on its own.
+ *************************/
+
+/* ct_next - Read the next token of a command line being compiled */
+static void ct_next(struct ctparse_t *cp)
+{
+    char *p = cp->p + strspn(cp->p, " \t\n");
+    size_t n, k;
+    int quote;
+
+    cp->tok = NULL;
+    cp->flags = 0;
+    if (*p == '\0') {
+	cp->p = p;
+	return;
+    }
+    if ((cp->tok = lexop(&p)) != NULL) {
+	cp->p = p;
+	return;
+    }
+
+    /* A word ends where parseline() would end it */
+    cp->tok = p;
+    for (;;) {
+	n = strcspn(p, " \t\n'\"\\|<>&;");
+	for (k = 0; k < n; k++) {
+	    if (p[k] == '*' || p[k] == '?' || p[k] == '[')
+		cp->flags |= W_GLOB;
+	    else if (p[k] == '$' && (isalpha((unsigned char)p[k+1]) || p[k+1] == '_' || p[k+1] == '{'))
+		cp->flags |= W_VAR;
+	}
+	p += n;
+	if (*p == '\'') {
+	    if ((p = strchr(p + 1, '\'')) == NULL) {
+		quote = '\'';
+		goto unterminated;
+	    }
+	    p++;
+	}
+	else if (*p == '"') {
+	    for (p++; *p != '"'; p++) {
+		if (*p == '\0') {
+		    quote = '"';
+		    goto unterminated;
+		}
+		if (*p == '\\' && p[1] != '\0')
+		    p++;
+		else if (*p == '$' && (isalpha((unsigned char)p[1]) || p[1] == '_' || p[1] == '{'))
+		    cp->flags |= W_VAR;
+	    }
+	    p++;
+	}
+	else if (*p == '\\')
+	    p += 1 + (p[1] != '\0' && p[1] != '\n');
+	else
+	    break;
+    }
+    cp->len = p - cp->tok;
+    cp->p = p;
+    if ((cp->flags & W_GLOB) && !globmeta(globpat(cp->tok, cp->len)))
+	cp->flags &= ~W_GLOB;  /* only a [ without its ], as in [ expr ] */
+    return;
+
+ unterminated:
+    printf("Syntax error: unterminated %c\n", quote);
+    cp->tok = NULL;
+    cp->err = 1;
+}
+
+/* ct_is - Return true if the current token is the word kw, unquoted */
+static int ct_is(struct ctparse_t *cp, const char *kw)
+{
+    return cp->tok != NULL && !isop(cp->tok) && cp->len == strlen(kw) &&
+	strncmp(cp->tok, kw, cp->len) == 0;
+}
+
+/* ct_syntax - Report a syntax error at the current token */
+static void ct_syntax(struct ctparse_t *cp)
+{
+    if (cp->err)
+	return;
+    if (cp->tok == NULL)
+	printf("Syntax error near 'newline'\n");
+    else
+	printf("Syntax error near '%.*s'\n", isop(cp->tok) ? (int)strlen(cp->tok) : (int)cp->len, cp->tok);
+    cp->err = 1;
+}
+
+/* ct_free - Free a list of commands */
+static void ct_free(struct node_t *n)
+{
+    struct node_t *next;
+
+    for (; n != NULL; n = next) {
+	next = n->next;
+	ct_free(n->body);
+	free(n->text);
+	free(n->cmd);
+	free(n->var);
+	free(n);
+    }
+}
+
+static struct node_t *ct_list(struct ctparse_t *cp, int indo);
+
+/* ct_block - Compile "do list; done" */
+static struct node_t *ct_block(struct ctparse_t *cp)
+{
+    struct node_t *body;
+
+    if (!ct_is(cp, "do")) {
+	ct_syntax(cp);
+	return NULL;
+    }
+    ct_next(cp);
+    body = ct_list(cp, 1);
+    if (cp->err)
+	return body;
+    if (!ct_is(cp, "done"))
+	ct_syntax(cp);
+    else if (body == NULL) {  /* do done */
+	ct_syntax(cp);
+    }
+    ct_next(cp);
+    return body;
+}
+
+/* 
+ * ct_item - Compile the command at the current token: a pipeline, or a
+ *     repeat or for loop. Returns NULL after a syntax error.
+ */
+static struct node_t *ct_item(struct ctparse_t *cp)
+{
+    struct node_t *n;
+    char *start, *end, *p;
+    size_t len;
+
+    if (cp->tok == NULL || isop(cp->tok) || ct_is(cp, "do") || ct_is(cp, "done")) {
+	ct_syntax(cp);
+	return NULL;
+    }
+    if ((n = calloc(1, sizeof(*n))) == NULL)
+	unix_error("calloc error");
+
+    if (ct_is(cp, "repeat")) {
+	n->type = N_REPEAT;
+	ct_next(cp);
+	if (cp->tok == NULL || isop(cp->tok) || cp->len > 18 ||
+	    strspn(cp->tok, "0123456789") != cp->len) {
+	    ct_syntax(cp);
+	    goto fail;
+	}
+	n->count = strtol(cp->tok, NULL, 10);
+	ct_next(cp);
+	n->body = ct_is(cp, "do") ? ct_block(cp) : ct_item(cp);
+	if (cp->err)
+	    goto fail;
+	return n;
+    }
+
+    if (ct_is(cp, "for")) {
+	n->type = N_FOR;
+	ct_next(cp);
+	if (cp->tok == NULL || isop(cp->tok) || cp->flags ||
+	    !(isalpha((unsigned char)*cp->tok) || *cp->tok == '_')) {
+	    ct_syntax(cp);
+	    goto fail;
+	}
+	for (p = cp->tok; p < cp->tok + cp->len; p++)
+	    if (!isalnum((unsigned char)*p) && *p != '_') {
+		ct_syntax(cp);
+		goto fail;
+	    }
+	n->var = strndup(cp->tok, cp->len);
+	ct_next(cp);
+	if (!ct_is(cp, "in")) {
+	    ct_syntax(cp);
+	    goto fail;
+	}
+	ct_next(cp);
+	start = end = cp->p;
+	if (cp->tok != NULL && !isop(cp->tok))
+	    start = cp->tok;
+	while (cp->tok != NULL && !isop(cp->tok)) {
+	    end = cp->p;
+	    ct_next(cp);
+	}
+	if (cp->tok != optab[OSEMI]) {
+	    ct_syntax(cp);
+	    goto fail;
+	}
+	n->text = strndup(start, end - start);
+	ct_next(cp);
+	n->body = ct_block(cp);
+	if (cp->err)
+	    goto fail;
+	return n;
+    }
+
+    n->type = N_CMD;
+    start = end = cp->tok;
+    while (cp->tok != NULL && (!isop(cp->tok) || cp->tok == optab[OPIPE] || cp->tok == optab[OIN] ||
+			       cp->tok == optab[OOUT] || cp->tok == optab[OAPPEND] || cp->tok == optab[ODUP])) {
+	n->dynamic |= cp->flags != 0;
+	end = cp->p;
+	ct_next(cp);
+    }
+    if (cp->err)
+	goto fail;
+    len = end - start;
+    if ((n->text = malloc(len + 4)) == NULL)
+	unix_error("malloc error");
+    memcpy(n->text, start, len);
+    strcpy(n->text + len, "\n");  /* " &" is added if it turns out to end with & */
+    return n;
+
+ fail:
+    ct_free(n);
+    return NULL;
+}
+
+/* 
+ * ct_list - Compile a list of commands, up to the end of the line, or
+ *     up to its "done" if indo. A loop ending with & runs its command
+ *     (if it has only one) as background jobs.
+ */
+static struct node_t *ct_list(struct ctparse_t *cp, int indo)
+{
+    struct node_t *head = NULL, **tail = &head, *n, *last;
+    int conn = C_SEQ;
+
+    for (;;) {
+	if (cp->tok == NULL && conn == C_SEQ && !cp->err) {
+	    if (indo)
+		ct_syntax(cp);  /* no done */
+	    break;
+	}
+	if (indo && conn == C_SEQ && ct_is(cp, "done"))
+	    break;
+	if ((n = ct_item(cp)) == NULL)
+	    break;
+	n->conn = conn;
+	*tail = n;
+	tail = &n->next;
+
+	if (cp->tok == NULL || (indo && ct_is(cp, "done")))
+	    conn = C_SEQ;
+	else if (cp->tok == optab[OSEMI]) {
+	    conn = C_SEQ;
+	    cp->nsep++;
+	    ct_next(cp);
+	}
+	else if (cp->tok == optab[OBG]) {
+	    for (last = n; last->type != N_CMD && last->body != NULL && last->body->next == NULL; last = last->body)
+		;
+	    if (last->type != N_CMD) {
+		ct_syntax(cp);
+		break;
+	    }
+	    last->bg = 1;
+	    strcpy(last->text + strlen(last->text) - 1, " &\n");
+	    conn = C_SEQ;
+	    cp->nsep++;
+	    ct_next(cp);
+	}
+	else if (cp->tok == optab[OAND] || cp->tok == optab[OOR]) {
+	    conn = cp->tok == optab[OAND] ? C_AND : C_OR;
+	    cp->nsep++;
+	    ct_next(cp);
+	}
+	else {
+	    ct_syntax(cp);
+	    break;
+	}
+    }
+    if (cp->err) {
+	ct_free(head);
+	return NULL;
+    }
+    return head;
+}
+
+/* ct_unlink - Take a tree out of the LRU list */
+static void ct_unlink(struct tree_t *t)
+{
+    if (t->prev != NULL)
+	t->prev->next = t->next;
+    else
+	treelru = t->next;
+    if (t->next != NULL)
+	t->next->prev = t->prev;
+    else
+	treeold = t->prev;
+}
+
+/* ct_front - Put a tree at the front of the LRU list */
+static void ct_front(struct tree_t *t)
+{
+    t->prev = NULL;
+    t->next = treelru;
+    if (treelru != NULL)
+	treelru->prev = t;
+    else
+	treeold = t;
+    treelru = t;
+}
+
+/* ct_evict - Drop the least recently used tree from the cache */
+static void ct_evict(void)
+{
+    struct tree_t *t = treeold, **tp;
+
+    ct_unlink(t);
+    for (tp = &treehash[strhash(t->line) % TREEHASH]; *tp != t; tp = &(*tp)->hnext)
+	;
+    *tp = t->hnext;
+    ntrees--;
+    t->evicted = 1;
+    if (t->pins == 0)
+	ct_release(t);
+}
+
+/* 
+ * ct_find - Return the compiled tree of a command line, from the cache
+ *     or compiled now, pinned until ct_release(). Prints an error and
+ *     returns NULL if it has a syntax error.
+ */
+struct tree_t *ct_find(char *line)
+{
+    struct tree_t *t;
+    struct ctparse_t cp;
+    struct node_t *nodes;
+    unsigned long h = strhash(line) % TREEHASH;
+
+    for (t = treehash[h]; t != NULL; t = t->hnext) {
+	if (strcmp(t->line, line) == 0) {
+	    if (t != treelru) {
+		ct_unlink(t);
+		ct_front(t);
+	    }
+	    t->pins++;
+	    return t;
+	}
+    }
+
+    cp.p = line;
+    cp.err = cp.nsep = 0;
+    ct_next(&cp);
+    if ((nodes = ct_list(&cp, 0)) == NULL && cp.err)
+	return NULL;
+    if (nodes != NULL && nodes->next == NULL && nodes->type == N_CMD && cp.nsep == nodes->bg) {
+	free(nodes->text);  /* a single command is known by the line as typed */
+	if ((nodes->text = strdup(line)) == NULL)
+	    unix_error("strdup error");
+    }
+    if ((t = calloc(1, sizeof(*t))) == NULL || (t->line = strdup(line)) == NULL)
+	unix_error("calloc error");
+    t->nodes = nodes;
+    t->pins = 1;
+    t->hnext = treehash[h];
+    treehash[h] = t;
+    ct_front(t);
+    if (++ntrees > TREECACHE)
+	ct_evict();
+    return t;
+}
+
+/* ct_release - Done with a tree returned by ct_find() */
+void ct_release(struct tree_t *t)
+{
+    if (t->pins > 0)
+	t->pins--;
+    if (t->pins == 0 && t->evicted) {
+	ct_free(t->nodes);
+	free(t->line);
+	free(t);
+    }
+}
+
+/* ct_lookup - Return the value of the loop variable named by the len
+ *     bytes at name, or NULL if there is none */
+static char *ct_lookup(const char *name, size_t len)
+{
+    struct var_t *v;
+
+    for (v = loopvars; v != NULL; v = v->next)
+	if (strlen(v->name) == len && strncmp(v->name, name, len) == 0)
+	    return v->value;
+    return NULL;
+}
+
+/* 
+ * ct_subst - Substitute the loop variables $name and ${name} in text,
+ *     outside single quotes, writing the result to out (if not NULL)
+ *     and returning its length. A value is always a single word, quoted
+ *     as needed so that its characters stand for themselves.
+ */
+static size_t ct_subst(const char *s, char *out)
+{
+    size_t n = 0, len, k;
+    int dq = 0;
+    const char *val, *e;
+
+#define EMIT(c) do { char c_ = (c); if (out != NULL) out[n] = c_; n++; } while (0)
+    while (*s != '\0') {
+	if (*s == '\'' && !dq && (e = strchr(s + 1, '\'')) != NULL) {
+	    for (; s <= e; s++)
+		EMIT(*s);
+	    continue;
+	}
+	if (*s == '\\' && s[1] != '\0') {
+	    EMIT(*s++);
+	    EMIT(*s++);
+	    continue;
+	}
+	if (*s == '"')
+	    dq = !dq;
+	if (*s == '$') {
+	    if (s[1] == '{' && (e = strchr(s + 2, '}')) != NULL) {
+		val = ct_lookup(s + 2, e - (s + 2));
+		len = e + 1 - s;
+	    }
+	    else {
+		for (e = s + 1; isalnum((unsigned char)*e) || *e == '_'; e++)
+		    ;
+		val = e > s + 1 ? ct_lookup(s + 1, e - (s + 1)) : NULL;
+		len = e - s;
+	    }
+	    if (val != NULL) {
+		if (dq) {
+		    for (; *val != '\0'; val++) {
+			if (strchr("\\\"$`", *val) != NULL)
+			    EMIT('\\');
+			EMIT(*val);
+		    }
+		}
+		else if (*val != '\0' && strcspn(val, " \t\n'\"\\|<>&;*?[$") == strlen(val)) {
+		    for (; *val != '\0'; val++)
+			EMIT(*val);
+		}
+		else {
+		    EMIT('\'');
+		    for (; *val != '\0'; val++) {
+			if (*val == '\'')
+			    for (k = 0; k < 3; k++)
+				EMIT("'\\'"[k]);
+			EMIT(*val);
+		    }
+		    EMIT('\'');
+		}
+		s += len;
+		continue;
+	    }
+	}
+	EMIT(*s++);
+    }
+#undef EMIT
+    if (out != NULL)
+	out[n] = '\0';
+    return n;
+}
+
+/* ct_expand - Return text with the loop variables substituted, in the arena */
+static char *ct_expand(const char *text)
+{
+    char *s = arena_alloc(ct_subst(text, NULL) + 1);
+
+    ct_subst(text, s);
+    return s;
+}
+
+/* 
+ * ct_save - Return a copy of a parsed command in a single block of
+ *     memory outside the arena
+ */
+static struct cmd_t *ct_save(struct cmd_t *cmd)
+{
+    struct cmd_t *c;
+    struct stage_t *last = &cmd->stages[cmd->nstages - 1];
+    size_t nwords, nredirs, size, len;
+    char *str;
+    int i;
+
+    for (nwords = last->argv - cmd->argv; cmd->argv[nwords] != NULL; nwords++)
+	;
+    nwords++;
+    nredirs = last->redirs + last->nredirs - cmd->stages[0].redirs;
+    size = sizeof(*c) + cmd->nstages * sizeof(struct stage_t) +
+	nredirs * sizeof(struct redir_t) + nwords * sizeof(char *);
+    for (i = 0; i < (int)nwords; i++)
+	if (cmd->argv[i] != NULL)
+	    size += strlen(cmd->argv[i]) + 1;
+    for (i = 0; i < (int)nredirs; i++)
+	if (cmd->stages[0].redirs[i].path != NULL)
+	    size += strlen(cmd->stages[0].redirs[i].path) + 1;
+    if ((c = malloc(size)) == NULL)
+	unix_error("malloc error");
+
+    *c = *cmd;
+    c->stages = (struct stage_t *)(c + 1);
+    memcpy(c->stages, cmd->stages, cmd->nstages * sizeof(struct stage_t));
+    c->stages[0].redirs = (struct redir_t *)(c->stages + cmd->nstages);
+    memcpy(c->stages[0].redirs, cmd->stages[0].redirs, nredirs * sizeof(struct redir_t));
+    c->argv = (char **)(c->stages[0].redirs + nredirs);
+    str = (char *)(c->argv + nwords);
+    for (i = 0; i < (int)nwords; i++) {
+	c->argv[i] = NULL;
+	if (cmd->argv[i] != NULL) {
+	    len = strlen(cmd->argv[i]) + 1;
+	    c->argv[i] = memcpy(str, cmd->argv[i], len);
+	    str += len;
+	}
+    }
+    for (i = 0; i < (int)nredirs; i++) {
+	if (cmd->stages[0].redirs[i].path != NULL) {
+	    len = strlen(cmd->stages[0].redirs[i].path) + 1;
+	    c->stages[0].redirs[i].path = memcpy(str, cmd->stages[0].redirs[i].path, len);
+	    str += len;
+	}
+    }
+    for (i = 0; i < cmd->nstages; i++) {
+	c->stages[i].argv = c->argv + (cmd->stages[i].argv - cmd->argv);
+	c->stages[i].redirs = c->stages[0].redirs + (cmd->stages[i].redirs - cmd->stages[0].redirs);
+    }
+    return c;
+}
+
+/* ct_runcmd - Run a pipeline of a tree */
+static void ct_runcmd(struct node_t *n)
+{
+    struct cmd_t cmd;
+    char *text = n->text;
+    int i;
+
+    if (n->dynamic || n->cmd == NULL) {
+	if (n->dynamic)
+	    text = ct_expand(text);
+	if (parsecmd(text, &cmd) <= 0)
+	    return;
+	if (!n->dynamic && cmd.pure)
+	    n->cmd = ct_save(&cmd);
+    }
+    else {
+	/* The stages are shared, as runcmd() and launch() set all
+	 * they use, but builtins may take their argv apart */
+	cmd = *n->cmd;
+	for (i = 0; cmd.argv[i] != NULL; i++)
+	    ;
+	cmd.argv = memcpy(arena_alloc((i + 1) * sizeof(char *)), cmd.argv, (i + 1) * sizeof(char *));
+    }
+    execcmd(&cmd, text);
+    if (!cmd.bg && laststatus == 128 + SIGINT)
+	interrupted = 1;  /* the job got the ctrl-c, which we never saw */
+}
+
+/* ct_iter - Run one iteration of a loop, then give back its memory, and
+ *     now and then look at signals and children */
+static void ct_iter(struct node_t *body, long i)
+{
+    struct amark_t m;
+
+    arena_mark(&m);
+    ct_run(body);
+    arena_release(&m);
+    if ((i + 1) % LOOPPOLL == 0)
+	ev_wait(0);
+}
+
+/* 
+ * ct_run - Run a list of commands. One joined by && (||) runs only if
+ *     the last status is (isn't) 0. Stops at a ctrl-c.
+ */
+void ct_run(struct node_t *n)
+{
+    struct var_t var;
+    char **words;
+    long i;
+
+    for (; n != NULL && !interrupted; n = n->next) {
+	if ((n->conn == C_AND && laststatus != 0) || (n->conn == C_OR && laststatus == 0))
+	    continue;
+	switch (n->type) {
+	case N_CMD:
+	    ct_runcmd(n);
+	    break;
+	case N_REPEAT:
+	    for (i = 0; i < n->count && !interrupted; i++)
+		ct_iter(n->body, i);
+	    break;
+	case N_FOR:
+	    if (parseline(ct_expand(n->text), &words) < 0)
+		return;
+	    var.name = n->var;
+	    var.next = loopvars;
+	    loopvars = &var;
+	    for (i = 0; words[i] != NULL && !interrupted; i++) {
+		var.value = words[i];
+		ct_iter(n->body, i);
+	    }
+	    loopvars = var.next;
+	    break;
+	}
+    }
+}
+
+/*****************************
+ * End command tree routines
+ *****************************/
+
+
+/***********************
+ * Job placement routines
+ *
+ * A "place" prefix pins the processes of a job to a set of CPUs, sets
+ * their nice value and I/O priority, and binds their memory to a NUMA
+ * node. The child applies all of it to itself once it has joined the
+ * job's process group, before the exec. "place -s" makes the shell
+ * spread the background jobs that aren't placed explicitly over the
+ * CPUs it may use, or over the NUMA nodes.
+ ***********************/
+
+char *ioclass[] = { "none", "realtime", "best-effort", "idle" };
+
+/* 
+ * parselist - Parse a CPU or node list like "0-3,8,10-11" into set.
+ *     Returns the number of members, or -1 if the list is malformed.
+ */
+static int parselist(const char *s, cpu_set_t *set)
+{
+    char *end;
+    long lo, hi;
+
+    CPU_ZERO(set);
+    do {
+	lo = hi = strtol(s, &end, 10);
+	if (end == s)
+	    return -1;
+	if (*end == '-') {
+	    s = end + 1;
+	    hi = strtol(s, &end, 10);
+	    if (end == s)
+		return -1;
+	}
+	if (lo < 0 || hi < lo || hi >= CPU_SETSIZE)
+	    return -1;
+	for (; lo <= hi; lo++)
+	    CPU_SET(lo, set);
+	s = end + 1;
+    } while (*end == ',');
+    return *end == '\0' || *end == '\n' ? CPU_COUNT(set) : -1;
+}
+
+/* 
+ * readlist - Parse the list in a sysfs file, as parselist
+ */
+static int readlist(const char *path, cpu_set_t *set)
+{
+    char buf[4096];
+    ssize_t n;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+	return -1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+	return -1;
+    buf[n] = '\0';
+    return parselist(buf, set);
+}
+
+/* 
+ * nthmember - Return the (n modulo its size)-th member of a non-empty set
+ */
+static int nthmember(cpu_set_t *set, unsigned n)
+{
+    int i;
+
+    n %= CPU_COUNT(set);
+    for (i = 0; !CPU_ISSET(i, set) || n-- > 0; i++)
+	;
+    return i;
+}
+
+/* 
+ * parseplace - Parse the options of a "place" prefix at *argvp into pl,
+ *     and advance *argvp to the command that follows them. -s sets the
+ *     spread mode right away; without it or a command, the mode is
+ *     shown. Prints an error and returns -1 if an option is invalid.
+ */
+int parseplace(char ***argvp, struct place_t *pl)
+{
+    char **argv = *argvp + 1, *opt, *arg, *end;
+    cpu_set_t allowed;
+    int i, spreadset = 0;
+    long n;
+
+    pl->set = 0;
+    for (; (opt = *argv) != NULL && opt[0] == '-' && opt[1] != '\0' && opt[2] == '\0'; argv++) {
+	if (opt[1] == '-') {
+	    argv++;
+	    break;
+	}
+	if ((arg = *++argv) == NULL)
+	    goto usage;
+	switch (opt[1]) {
+	case 'c':
+	    if (parselist(arg, &pl->cpus) <= 0)
+		goto usage;
+	    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+		CPU_AND(&allowed, &allowed, &pl->cpus);
+		if (CPU_COUNT(&allowed) == 0) {
+		    printf("place: %s: no usable CPU\n", arg);
+		    return -1;
+		}
+	    }
+	    pl->set |= PL_CPUS;
+	    break;
+	case 'n':
+	    n = strtol(arg, &end, 10);
+	    if (end == arg || *end != '\0' || n < -20 || n > 19)
+		goto usage;
+	    pl->nice = n;
+	    pl->set |= PL_NICE;
+	    break;
+	case 'i':
+	    n = strcspn(arg, ":");
+	    for (i = 1; i < 4; i++)
+		if ((size_t)n == strlen(ioclass[i]) && strncmp(arg, ioclass[i], n) == 0)
+		    break;
+	    if (i == 4 && (n != 1 || (i = arg[0] - '0') < 1 || i > 3))
+		goto usage;
+	    pl->ioprio = i << IOPRIO_CLASS_SHIFT;
+	    if (arg[n] == ':') {
+		if (arg[n+1] < '0' || arg[n+1] > '7' || arg[n+2] != '\0')
+		    goto usage;
+		pl->ioprio |= arg[n+1] - '0';
+	    }
+	    else if (i != 3)
+		pl->ioprio |= 4;  /* the default level */
+	    pl->set |= PL_IO;
+	    break;
+	case 'm':
+	    n = strtol(arg, &end, 10);
+	    if (end == arg || *end != '\0' || n < 0 || n >= MAXNODE)
+		goto usage;
+	    if (readlist("/sys/devices/system/node/online", &allowed) > 0 && !CPU_ISSET(n, &allowed)) {
+		printf("place: %s: no such NUMA node\n", arg);
+		return -1;
+	    }
+	    pl->node = n;
+	    pl->set |= PL_NODE;
+	    break;
+	case 's':
+	    if (strcmp(arg, "off") == 0)
+		spread = SP_OFF;
+	    else if (strcmp(arg, "cores") == 0)
+		spread = SP_CORES;
+	    else if (strcmp(arg, "nodes") == 0)
+		spread = SP_NODES;
+	    else
+		goto usage;
+	    spreadnext = 0;
+	    spreadset = 1;
+	    break;
+	default:
+	    goto usage;
+	}
+    }
+    if (*argv == NULL && !spreadset)
+	printf("place: background jobs %s\n", spread == SP_CORES ? "spread across cores" :
+	       spread == SP_NODES ? "spread across NUMA nodes" : "not spread");
+    *argvp = argv;
+    return 0;
+
+ usage:
+    printf("usage: place [-c cpus] [-n nice] [-i class[:level]] [-m node] command ...\n"
+	   "       place -s cores|nodes|off\n");
+    return -1;
+}
+
+/* 
+ * autoplace - Place a background job on the next CPU or NUMA node,
+ *     according to the spread mode
+ */
+void autoplace(struct place_t *pl)
+{
+    cpu_set_t set;
+    char path[64];
+    int node;
+
+    if (spread == SP_CORES) {
+	if (sched_getaffinity(0, sizeof(set), &set) < 0 || CPU_COUNT(&set) == 0)
+	    return;
+	CPU_ZERO(&pl->cpus);
+	CPU_SET(nthmember(&set, spreadnext++), &pl->cpus);
+	pl->set |= PL_CPUS;
+    }
+    else if (spread == SP_NODES) {
+	if (readlist("/sys/devices/system/node/online", &set) <= 0)
+	    return;  /* not a NUMA kernel */
+	node = nthmember(&set, spreadnext++);
+	sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+	if (readlist(path, &pl->cpus) > 0)
+	    pl->set |= PL_CPUS;
+	if (!(pl->set & PL_NODE)) {
+	    pl->node = node;
+	    pl->set |= PL_NODE;
+	}
+    }
+}
+
+/* 
+ * applyplace - Apply a placement to the calling process. Only uses
+ *     system calls, so it is safe in a vfork() child. Returns -1 with
+ *     errno set if any part of it fails.
+ */
+int applyplace(struct place_t *pl)
+{
+    unsigned long nodes[MAXNODE / (8 * sizeof(long))];
+
+    if ((pl->set & PL_CPUS) && sched_setaffinity(0, sizeof(pl->cpus), &pl->cpus) < 0)
+	return -1;
+    if ((pl->set & PL_NICE) && setpriority(PRIO_PROCESS, 0, pl->nice) < 0)
+	return -1;
+    if ((pl->set & PL_IO) && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, pl->ioprio) < 0)
+	return -1;
+    if (pl->set & PL_NODE) {
+	memset(nodes, 0, sizeof(nodes));
+	nodes[pl->node / (8 * sizeof(long))] |= 1UL << (pl->node % (8 * sizeof(long)));
+	if (syscall(SYS_set_mempolicy, MPOL_BIND, nodes, 8 * sizeof(nodes) + 1) < 0)
+	    return -1;
+    }
+    return 0;
+}
+
+/* 
+ * printplace - Print a job's placement, for jobs -l
+ */
+void printplace(struct place_t *pl)
+{
+    char sep = '=';
+    int i, j;
+
+    if (pl->set & PL_CPUS) {
+	printf("cpus");
+	for (i = 0; i < CPU_SETSIZE; i = j + 1) {
+	    for (j = i; j < CPU_SETSIZE && CPU_ISSET(j, &pl->cpus); j++)
+		;
+	    if (j > i + 1)
+		printf("%c%d-%d", sep, i, j - 1);
+	    else if (j > i)
+		printf("%c%d", sep, i);
+	    sep = j > i ? ',' : sep;
+	}
+	printf(" ");
+    }
+    if (pl->set & PL_NICE)
+	printf("nice=%d ", pl->nice);
+    if (pl->set & PL_IO)
+	printf("io=%s:%d ", ioclass[pl->ioprio >> IOPRIO_CLASS_SHIFT], pl->ioprio & 7);
+    if (pl->set & PL_NODE)
+	printf("node=%d ", pl->node);
+}
+
+/****************************
+ * End job placement routines
+ ****************************/
+
+/**********************************
+ * Background job queue routines
+ *
+ * Once limits are set with the queue builtin, a new background job is
+ * added to the job list in the QU state, without any process, and
+ * waits in a heap ordered by priority, then by submission. It starts
+ * when the number of running background jobs, the load and the free
+ * memory allow it. Those are checked whenever a job ends, and every
+ * second while jobs are queued. The load is the larger of the 1-minute
+ * load average and the number of runnable tasks right now, so that
+ * jobs just started count at once. Jobs let through on load or memory
+ * are started one per second, to give them time to show up there.
+ **********************************/
+
+/* 
+ * parsequeue - Parse the options of the queue builtin or prefix at
+ *     *argvp, and advance *argvp past them. -p sets the priority of the
+ *     command that follows; -n, -l and -m set the limits. Without a
+ *     command, the limits and the queue are shown. Prints an error and
+ *     returns -1 if an option is invalid.
+ */
+int parsequeue(char ***argvp, int *prio)
+{
+    char **argv = *argvp + 1, *opt, *arg, *end;
+    struct qlimits_t lim = qlimits;
+    int i, limset = 0;
+    double n;
+
+    for (; (opt = *argv) != NULL && opt[0] == '-' && opt[1] != '\0' && opt[2] == '\0'; argv++) {
+	if (opt[1] == '-') {
+	    argv++;
+	    break;
+	}
+	if ((arg = *++argv) == NULL)
+	    goto usage;
+	n = strtod(arg, &end);
+	if (end == arg || *end != '\0')
+	    goto usage;
+	switch (opt[1]) {
+	case 'p':
+	    *prio = n;
+	    continue;
+	case 'n':
+	    lim.maxrun = n;
+	    break;
+	case 'l':
+	    lim.maxload = n;
+	    break;
+	case 'm':
+	    lim.minfree = n;
+	    break;
+	default:
+	    goto usage;
+	}
+	if (n < 0)
+	    goto usage;
+	limset = 1;
+    }
+    qlimits = lim;
+    if (*argv == NULL && !limset) {
+	printf("queue: running %d, load %g, free memory %ldMB (0 for no limit)\n",
+	       qlimits.maxrun, qlimits.maxload, qlimits.minfree);
+	for (i = 0; i < qlen; i++)
+	    printf("[%d] priority %d %s", queue[i]->jid, queue[i]->prio, queue[i]->cmdline);
+    }
+    else if (limset)
+	qadmit();  /* they may have been raised */
+    *argvp = argv;
+    return 0;
+
+ usage:
+    printf("usage: queue [-p priority] command ... &\n"
+	   "       queue [-n maxrunning] [-l maxload] [-m minfreeMB]\n");
+    return -1;
+}
+
+/* qactive - Return true if background jobs go through the queue */
+int qactive(void)
+{
+    return qlimits.maxrun > 0 || qlimits.maxload > 0 || qlimits.minfree > 0;
+}
+
+/* qbefore - Return true if queued job a should start before b */
+static int qbefore(struct job_t *a, struct job_t *b)
+{
+    return a->prio != b->prio ? a->prio > b->prio : (int)(a->seq - b->seq) < 0;
+}
+
+/* qplace - Store job at position i of the heap */
+static void qplace(struct job_t *job, int i)
+{
+    queue[i] = job;
+    job->qidx = i;
+}
+
+/* qsift - Move the job at position i up or down the heap into place */
+static void qsift(int i)
+{
+    struct job_t *job = queue[i];
+    int c;
+
+    for (; i > 0 && qbefore(job, queue[(i-1)/2]); i = (i-1)/2)
+	qplace(queue[(i-1)/2], i);
+    for (; (c = 2*i + 1) < qlen; i = c) {
+	if (c + 1 < qlen && qbefore(queue[c+1], queue[c]))
+	    c++;
+	if (!qbefore(queue[c], job))
+	    break;
+	qplace(queue[c], i);
+    }
+    qplace(job, i);
+}
+
+/* qpush - Add a QU job to the queue */
+void qpush(struct job_t *job)
+{
+    if (qlen == qcap) {
+	qcap = qcap ? 2 * qcap : 16;
+	if ((queue = realloc(queue, qcap * sizeof(*queue))) == NULL)
+	    unix_error("realloc error");
+    }
+    job->seq = qseq++;
+    qplace(job, qlen++);
+    qsift(job->qidx);
+}
+
+/* qremove - Take a job out of the queue */
+void qremove(struct job_t *job)
+{
+    int i = job->qidx;
+
+    if (--qlen > i) {
+	qplace(queue[qlen], i);
+	qsift(i);
+    }
+}
+
+/* 
+ * qload - Return the load, as described above, or -1 if unknown
+ */
+static double qload(void)
+{
+    char buf[128];
+    double avg;
+    int fd, running;
+    ssize_t n;
+
+    if ((fd = open("/proc/loadavg", O_RDONLY | O_CLOEXEC)) < 0)
+	return -1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+	return -1;
+    buf[n] = '\0';
+    if (sscanf(buf, "%lf %*f %*f %d", &avg, &running) != 2)
+	return -1;
+    running--;  /* ourselves */
+    return running > avg ? running : avg;
+}
+
+/* 
+ * qfree - Return the available memory in MB, or -1 if unknown
+ */
+static long qfree(void)
+{
+    char buf[4096], *p;
+    int fd;
+    ssize_t n;
+
+    if ((fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC)) < 0)
+	return -1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+	return -1;
+    buf[n] = '\0';
+    if ((p = strstr(buf, "MemAvailable:")) == NULL)
+	return -1;
+    return atol(p + 13) / 1024;
+}
+
+/* 
+ * qtick - Timer handler: recheck the limits while jobs are queued
+ */
+static void qtick(int fd, void *arg)
+{
+    uint64_t n;
+
+    if (read(fd, &n, sizeof(n)) < 0 && errno != EAGAIN)
+	return;
+    qadmit();
+}
+
+/* 
+ * qadmit - Start the queued jobs that the limits allow, in order
+ */
+void qadmit(void)
+{
+    struct timespec now;
+    long free;
+    double load;
+
+    while (qlen > 0) {
+	if (qlimits.maxrun > 0 && jobs.nrunning >= qlimits.maxrun)
+	    break;
+	if (qlimits.maxload > 0 || qlimits.minfree > 0) {
+	    clock_gettime(CLOCK_MONOTONIC, &now);
+	    if (now.tv_sec - qlast.tv_sec + (now.tv_nsec - qlast.tv_nsec) / 1e9 < 1)
+		break;
+	    if (qlimits.maxload > 0 && (load = qload()) >= 0 && load >= qlimits.maxload)
+		break;
+	    if (qlimits.minfree > 0 && (free = qfree()) >= 0 && free < qlimits.minfree)
+		break;
+	    qlast = now;
+	}
+	startjob(queue[0], BG);
+    }
+
+    if (qlen > 0 && qtimer == NULL)
+	qtimer = ev_timer(1000, 1, qtick, NULL);
+    else if (qlen == 0 && qtimer != NULL) {
+	ev_del(qtimer);
+	close(qtimer->fd);
+	qtimer = NULL;
+    }
+}
+
+/* 
+ * startjob - Take a job out of the queue and start it, in the
+ *     foreground or background (state). If it can't be started, it is
+ *     removed from the job list. Returns 1 if it started, 0 if not.
+ */
+int startjob(struct job_t *job, int state)
+{
+    struct cmd_t cmd;
+
+    qremove(job);
+    if (parsecmd(job->cmdline, &cmd) <= 0) {
+	removejob(&jobs, job);
+	return 0;
+    }
+    cmd.bg = state == BG;
+    if (runcmd(&cmd, job->cmdline, job) == NULL) {
+	removejob(&jobs, job);
+	return 0;
+    }
+    if (state == BG)
+	printf("[%d] (%d) %s", job->jid, job->pid, job->cmdline);
+    return 1;
+}
+
+/*************************************
+ * End background job queue routines
+ *************************************/
+
+/*************************
+ * Event stream routines
+ *
+ * With -e fd, every change in the life of a job is written to fd as a
+ * JSON object on a line of its own: "queued", "spawned", "stopped",
+ * "continued", and "exited" or "signaled" with the job's resource
+ * usage. Each has the CLOCK_MONOTONIC time "t", "jid" and "pgid".
+ * The descriptor is made non-blocking and events are buffered, so a
+ * slow reader never holds up the shell; the event loop writes them
+ * out as the reader catches up. Should the buffer fill up, events are
+ * dropped and a "dropped" event with their count follows.
+ *************************/
+
+static void es_ready(int fd, void *arg);
+
+/* 
+ * es_flush - Write as much of the buffer as fd takes without blocking,
+ *     and watch for it to become writable if something is left. The
+ *     stream is turned off if the reader has gone away.
+ */
+static void es_flush(void)
+{
+    ssize_t n;
+    size_t off = 0;
+
+    while (off < estream.len) {
+	if ((n = write(estream.fd, estream.buf + off, estream.len - off)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno != EAGAIN) {
+		estream.len = off = 0;  /* e.g. EPIPE: no one is listening anymore */
+		if (estream.src != NULL)
+		    ev_del(estream.src);
+		estream.src = NULL;
+		estream.fd = -1;
+		return;
+	    }
+	    break;
+	}
+	off += n;
+    }
+    memmove(estream.buf, estream.buf + off, estream.len - off);
+    estream.len -= off;
+    if (estream.len > 0 && estream.src == NULL)
+	estream.src = ev_add(estream.fd, EPOLLOUT, es_ready, NULL);
+    else if (estream.len == 0 && estream.src != NULL) {
+	ev_del(estream.src);
+	estream.src = NULL;
+    }
+}
+
+/* es_ready - Event handler: fd is writable again */
+static void es_ready(int fd, void *arg)
+{
+    es_flush();
+}
+
+/* es_drain - Write out what is left in the buffer at exit, unless the
+ *     reader takes more than a second to make room for it */
+static void es_drain(void)
+{
+    struct pollfd pfd;
+
+    pfd.fd = estream.fd;
+    pfd.events = POLLOUT;
+    while (estream.fd >= 0 && estream.len > 0 && poll(&pfd, 1, 1000) > 0)
+	es_flush();
+}
+
+/* 
+ * es_open - Send the event stream to fd
+ */
+void es_open(int fd)
+{
+    sigset_t mask;
+
+    estream.fd = fd;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    /* A reader that goes away must not kill the shell. Children get
+     * the original signal mask back, so they still see SIGPIPE. */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    atexit(es_drain);
+}
+
+/* 
+ * es_begin - Start an event about a job. The other es_ routines add to
+ *     it, es_end sends it. They do nothing if the stream is off.
+ */
+void es_begin(const char *event, struct job_t *job)
+{
+    struct timespec now;
+
+    if (estream.fd < 0)
+	return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (estream.dropped > 0 && estream.len + 128 < ESBUFSZ) {
+	estream.len += sprintf(estream.buf + estream.len,
+			       "{\"t\":%ld.%09ld,\"event\":\"dropped\",\"count\":%lu}\n",
+			       (long)now.tv_sec, now.tv_nsec, estream.dropped);
+	estream.dropped = 0;
+    }
+    estream.mark = estream.len;
+    estream.full = 0;
+    es_printf("{\"t\":%ld.%09ld,\"event\":\"%s\",\"jid\":%d,\"pgid\":%d",
+	      (long)now.tv_sec, now.tv_nsec, event, job->jid, job->pid);
+}
+
+/* es_printf - Add formatted text to the current event */
+void es_printf(const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (estream.fd < 0 || estream.full)
+	return;
+    va_start(ap, fmt);
+    n = vsnprintf(estream.buf + estream.len, ESBUFSZ - estream.len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= ESBUFSZ - estream.len)
+	estream.full = 1;
+    else
+	estream.len += n;
+}
+
+/* 
+ * utf8len - Return the length of the well-formed UTF-8 character at s,
+ *     0 if the bytes there are not one
+ */
+static int utf8len(const unsigned char *s)
+{
+    unsigned int c;
+    int len, i;
+
+    if (s[0] < 0x80)
+	return 1;
+    else if (s[0] >= 0xc2 && s[0] <= 0xdf)
+	len = 2, c = s[0] & 0x1f;
+    else if (s[0] >= 0xe0 && s[0] <= 0xef)
+	len = 3, c = s[0] & 0x0f;
+    else if (s[0] >= 0xf0 && s[0] <= 0xf4)
+	len = 4, c = s[0] & 0x07;
+    else
+	return 0;
+    for (i = 1; i < len; i++) {
+	if ((s[i] & 0xc0) != 0x80)
+	    return 0;  /* also stops at the terminating NUL */
+	c = c << 6 | (s[i] & 0x3f);
+    }
+    /* No overlong forms, surrogates, or code points past U+10FFFF */
+    if ((len == 3 && c < 0x800) || (len == 4 && c < 0x10000) ||
+	(c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff)
+	return 0;
+    return len;
+}
+
+/* es_string - Add a string member to the current event, escaped for JSON,
+ *     without a trailing newline. Bytes that are not UTF-8 become U+FFFD. */
+void es_string(const char *name, const char *str)
+{
+    int n;
+
+    es_printf(",\"%s\":\"", name);
+    for (; *str && !estream.full; str += n) {
+	n = 1;
+	if (*str == '\n' && str[1] == '\0')
+	    break;  /* a command line's own newline */
+	if (*str == '"' || *str == '\\')
+	    es_printf("\\%c", *str);
+	else if ((unsigned char)*str < 0x20)
+	    es_printf("\\u%04x", *str);
+	else if ((n = utf8len((const unsigned char *)str)) == 0) {
+	    es_printf("\\ufffd");
+	    n = 1;
+	}
+	else if (estream.len + n <= ESBUFSZ) {
+	    memcpy(estream.buf + estream.len, str, n);
+	    estream.len += n;
+	}
+	else
+	    estream.full = 1;
+    }
+    es_printf("\"");
+}
+
+/* es_end - Finish the current event and send it */
+void es_end(void)
+{
+    if (estream.fd < 0)
+	return;
+    es_printf("}\n");
+    if (estream.full) {
+	estream.len = estream.mark;
+	estream.dropped++;
+    }
+    es_flush();
+}
+
+/*****************************
+ * End event stream routines
+ *****************************/
+
+/***************************
+ * Output capture routines
+ *
+ * With -b size, the stdout and stderr of every background job go to a
+ * pipe that the event loop drains without blocking into a ring of the
+ * job's last size bytes, so jobs running side by side don't garble
+ * the terminal. What is left unshown is printed in one piece when the
+ * job is over, or as it comes while it is in the foreground, and the
+ * output builtin shows it at any time. Bytes pushed out of a full ring
+ * are spilled to an unnamed temporary file, so nothing is lost.
+ ***************************/
+
+/* ob_spill - Append n bytes pushed out of the ring to the spill file,
+ *     creating it the first time. Should that fail, they are lost. */
+static void ob_spill(struct outbuf_t *ob, const char *p, size_t n)
+{
+    const char *dir = getenv("TMPDIR");
+    ssize_t w;
+
+    if (ob->spillfd < 0 && ob->spilled == ob->total - capsize)
+	ob->spillfd = open(dir != NULL ? dir : "/tmp", O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    while (ob->spillfd >= 0 && n > 0) {
+	if ((w = write(ob->spillfd, p, n)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    close(ob->spillfd);
+	    ob->spillfd = -1;
+	    return;
+	}
+	ob->spilled += w;
+	p += w;
+	n -= w;
+    }
+}
+
+/* ob_put - Add n bytes to the ring, spilling the oldest if it is full */
+static void ob_put(struct outbuf_t *ob, const char *p, size_t n)
+{
+    size_t at, k;
+
+    while (n > 0) {
+	at = ob->total % capsize;
+	k = capsize - at < n ? capsize - at : n;
+	if (ob->total >= capsize)
+	    ob_spill(ob, ob->buf + at, k);
+	memcpy(ob->buf + at, p, k);
+	ob->total += k;
+	p += k;
+	n -= k;
+    }
+}
+
+/* ob_ready - Event handler: the job has written something */
+static void ob_ready(int fd, void *arg)
+{
+    ob_read(arg);
+}
+
+/* 
+ * ob_open - Set up the capture of a job's output. Returns it with the
+ *     write end of its pipe in *wfd, for the job's processes, or NULL
+ *     after printing why it can't be captured.
+ */
+struct outbuf_t *ob_open(int *wfd)
+{
+    struct outbuf_t *ob;
+    int fds[2];
+
+    if ((ob = calloc(1, sizeof(*ob))) == NULL || (ob->buf = malloc(capsize)) == NULL) {
+	free(ob);
+	printf("capture: %s\n", strerror(ENOMEM));
+	return NULL;
+    }
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+	printf("capture: %s\n", strerror(errno));
+	free(ob->buf);
+	free(ob);
+	return NULL;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETPIPE_SZ, PIPESZ);  /* best effort, fewer wakeups */
+    ob->fd = fds[0];
+    ob->spillfd = -1;
+    ob->src = ev_add(fds[0], EPOLLIN, ob_ready, ob);
+    *wfd = fds[1];
+    return ob;
+}
+
+/* 
+ * ob_read - Take in what is waiting in the pipe, and stop watching it
+ *     at EOF
+ */
+void ob_read(struct outbuf_t *ob)
+{
+    char buf[CAPCHUNK];
+    ssize_t n;
+
+    while (ob->fd >= 0) {
+	if ((n = read(ob->fd, buf, sizeof(buf))) > 0) {
+	    ob_put(ob, buf, n);
+	    continue;
+	}
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0 && errno == EAGAIN)
+	    return;
+	ev_del(ob->src);
+	close(ob->fd);
+	ob->fd = -1;
+    }
+}
+
+/* 
+ * ob_show - Print the captured output from byte from on, from the spill
+ *     file and then the ring, and note that all of it has been shown
+ */
+void ob_show(struct outbuf_t *ob, size_t from)
+{
+    char buf[CAPCHUNK];
+    size_t lo = ob->total > capsize ? ob->total - capsize : 0;  /* oldest byte in the ring */
+    size_t at, k;
+    ssize_t n;
+
+    for (; from < lo && from < ob->spilled; from += n) {
+	k = ob->spilled - from < sizeof(buf) ? ob->spilled - from : sizeof(buf);
+	if ((n = pread(ob->spillfd, buf, k, from)) <= 0)
+	    break;
+	fwrite(buf, 1, n, stdout);
+    }
+    if (from < lo) {
+	printf("[%zu bytes of output lost]\n", lo - from);
+	from = lo;
+    }
+    for (; from < ob->total; from += k) {
+	at = from % capsize;
+	k = capsize - at < ob->total - from ? capsize - at : ob->total - from;
+	fwrite(ob->buf + at, 1, k, stdout);
+    }
+    ob->printed = ob->total;
+    fflush(stdout);
+}
+
+/* ob_close - Stop capturing and release the buffer and spill file */
+void ob_close(struct outbuf_t *ob)
+{
+    if (ob->fd >= 0) {
+	ev_del(ob->src);
+	close(ob->fd);
+    }
+    if (ob->spillfd >= 0)
+	close(ob->spillfd);
+    free(ob->buf);
+    free(ob);
+}
+
+/*******************************
+ * End output capture routines
+ *******************************/
+
+/**********************
+ * Job server routines
+ *
+ * With -s path, the shell also listens on a UNIX socket, so that many
+ * clients can share one long-lived shell and its job table instead of
+ * each starting a shell of its own. A client sends command lines, one
+ * per line; the shell runs each with its stdout and stderr going to
+ * the client, and ends the answer with a NUL byte and the command's
+ * exit status on a line. Connections are read without blocking from
+ * the event loop, and their commands are run between the shell's own
+ * command lines, one at a time, so every client sees a consistent job
+ * table. Commands from a client always run in the background, with the
+ * shell's own stdout, stderr and stdin. Builtins that would take over
+ * the terminal or block the server (fg, parallel, output -f) are
+ * refused, and wait is answered once the jobs are over, without
+ * holding up anyone else.
+ **********************/
+
+static void srv_accept(int fd, void *arg);
+
+/* srv_unlink - Remove the socket at exit */
+static void srv_unlink(void)
+{
+    unlink(srvpath);
+}
+
+/* 
+ * srv_open - Start serving jobs on a UNIX socket at path
+ */
+void srv_open(char *path)
+{
+    struct sockaddr_un addr;
+    sigset_t mask;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+	printf("%s: %s\n", path, strerror(ENAMETOOLONG));
+	exit(1);
+    }
+    strcpy(addr.sun_path, path);
+    if ((srvfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0 ||
+	bind(srvfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	listen(srvfd, SOMAXCONN) < 0)
+	unix_error(path);
+    srvpath = path;
+    atexit(srv_unlink);
+    ev_add(srvfd, EPOLLIN, srv_accept, NULL);
+
+    /* A client that goes away must not kill the shell. Children get
+     * the original signal mask back, so they still see SIGPIPE. */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+}
+
+/* 
+ * srv_read - Event handler: take in what a client has sent, and run it
+ *     unless the shell is busy with a command line already
+ */
+static void srv_read(int fd, void *arg)
+{
+    struct client_t *c = arg;
+    ssize_t n;
+
+    while (1) {
+	if (c->len == c->cap) {
+	    if (c->cap >= CLIENTBUF) {  /* srv_run reads on once it has run some of it */
+		ev_del(c->src);
+		c->src = NULL;
+		break;
+	    }
+	    c->cap = c->cap ? c->cap * 2 : MAXLINE;
+	    if ((c->buf = realloc(c->buf, c->cap)) == NULL)
+		unix_error("realloc error");
+	}
+	if ((n = recv(fd, c->buf + c->len, c->cap - c->len, MSG_DONTWAIT)) > 0) {
+	    c->len += n;
+	    continue;
+	}
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0 && errno == EAGAIN)
+	    break;
+	ev_del(c->src);  /* shut down, or gone */
+	c->src = NULL;
+	c->eof = 1;
+	break;
+    }
+    if (!busy)
+	srv_run();
+}
+
+/* srv_accept - Event handler: take in the waiting connections */
+static void srv_accept(int fd, void *arg)
+{
+    struct client_t *c;
+    struct timeval tv = { 1, 0 };
+    int cfd;
+
+    while ((cfd = accept4(fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+	    unix_error("calloc error");
+	c->fd = cfd;
+	/* Answers are written with the shell's stdio, so the socket
+	 * blocks, but a client that doesn't read them is given up on */
+	setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	if ((c->src = ev_add(cfd, EPOLLIN, srv_read, c)) == NULL) {
+	    close(cfd);
+	    free(c);
+	    continue;
+	}
+	c->next = clients;
+	clients = c;
+	if (verbose)
+	    printf("Client %d connected\n", cfd);
+    }
+}
+
+/* srv_answer - End the answer to a client's command with its status */
+static void srv_answer(struct client_t *c, int status)
+{
+    char buf[16];
+    int n;
+
+    n = snprintf(buf, sizeof(buf), "%c%d\n", '\0', status);
+    if (send(c->fd, buf, n, MSG_NOSIGNAL) < 0)
+	c->eof = 1, c->len = 0;
+}
+
+/* 
+ * srv_eval - Run a command line of a client, with our stdout and
+ *     stderr going to it
+ */
+static void srv_eval(struct client_t *c, char *cmdline)
+{
+    int saved[2], i;
+
+    fflush(stdout);
+    for (i = 0; i < 2; i++) {
+	saved[i] = fcntl(i + 1, F_DUPFD_CLOEXEC, 3);
+	dup2(c->fd, i + 1);
+    }
+    srvout = saved[0];
+    client = c;
+    busy = 1;
+    eval(cmdline);
+    arena_reset();
+    busy = 0;
+    client = NULL;
+    srvout = -1;
+    fflush(stdout);
+    for (i = 0; i < 2; i++) {
+	dup2(saved[i], i + 1);
+	close(saved[i]);
+    }
+    if (!c->waiting)
+	srv_answer(c, laststatus);
+}
+
+/* srv_waitended - Note how the last job a client waits for ended */
+static void srv_waitended(struct job_t *job, int status)
+{
+    struct client_t *c = job->data;
+
+    c->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/* srv_unwait - End a client's wait, leaving its jobs alone */
+static void srv_unwait(struct client_t *c)
+{
+    struct job_t *job;
+
+    if (c->nwait > 0 && (job = getjobjid(&jobs, c->waitjids[c->nwait - 1])) != NULL &&
+	job->done == srv_waitended && job->data == c) {
+	job->done = NULL;  /* it was stopped */
+	job->data = NULL;
+    }
+    c->waiting = 0;
+    free(c->waitjids);
+    c->waitjids = NULL;
+}
+
+/* srv_waitdone - Return true once the jobs a client waits for are over
+ *     (or stopped), as for the wait builtin */
+static int srv_waitdone(struct client_t *c)
+{
+    struct job_t *job;
+    int i;
+
+    if (c->nwait == 0) {
+	for (job = jobs.head; job != NULL; job = job->next)
+	    if (job->state == BG || job->state == QU)
+		return 0;
+	return 1;
+    }
+    for (i = 0; i < c->nwait; i++)
+	if ((job = getjobjid(&jobs, c->waitjids[i])) != NULL && (job->state == BG || job->state == QU))
+	    return 0;
+    return 1;
+}
+
+/* 
+ * srv_run - Run the complete command lines the clients have sent, and
+ *     answer the waits that are over. Connections that have shut down
+ *     are closed once nothing is left to do for them.
+ */
+void srv_run(void)
+{
+    struct client_t *c, **cp;
+    char *nl, *line;
+    size_t n;
+
+    for (cp = &clients; (c = *cp) != NULL; ) {
+	if (c->waiting && srv_waitdone(c)) {
+	    srv_unwait(c);
+	    srv_answer(c, c->status);
+	}
+	while (!c->waiting && (nl = memchr(c->buf, '\n', c->len)) != NULL) {
+	    n = nl - c->buf + 1;
+	    line = strncpy(arena_alloc(n + 1), c->buf, n);
+	    line[n] = '\0';
+	    memmove(c->buf, nl + 1, c->len - n);
+	    c->len -= n;
+	    srv_eval(c, line);
+	}
+	if (c->src == NULL && !c->eof && !c->waiting) {  /* its buffer was full */
+	    if (c->len == c->cap && memchr(c->buf, '\n', c->len) == NULL) {
+		send(c->fd, "Line too long\n", 14, MSG_NOSIGNAL);
+		srv_answer(c, 1);
+		c->len = 0;
+		c->eof = 1;
+	    }
+	    else if (c->len < c->cap && (c->src = ev_add(c->fd, EPOLLIN, srv_read, c)) == NULL)
+		c->eof = 1;
+	}
+	if (c->eof && !c->waiting) {
+	    if (c->src != NULL)
+		ev_del(c->src);
+	    close(c->fd);
+	    free(c->buf);
+	    *cp = c->next;
+	    free(c);
+	    continue;
+	}
+	cp = &c->next;
+    }
+}
+
+/* 
+ * srv_allowed - Return false for the builtins a client may not run
+ */
+int srv_allowed(char **argv)
+{
+    return strcmp(argv[0], "fg") != 0 && strcmp(argv[0], "parallel") != 0 &&
+	!(strcmp(argv[0], "output") == 0 && argv[1] != NULL && strcmp(argv[1], "-f") == 0);
+}
+
+/* 
+ * srv_wait - The wait builtin of a client: note the jobs it waits for,
+ *     so that srv_run answers once they are over. Returns the status
+ *     for jobs that don't exist, like wait.
+ */
+int srv_wait(char **argv)
+{
+    struct job_t *job, *last = NULL;
+    int i, status = 0;
+
+    for (i = 1; argv[i] != NULL; i++)
+	;
+    if ((client->waitjids = malloc(i * sizeof(int))) == NULL)
+	unix_error("malloc error");
+    client->nwait = 0;
+    for (i = 1; argv[i] != NULL; i++) {
+	last = job = argv[i][0] == '%' ? getjobjid(&jobs, atoi(argv[i] + 1)) : getjobpid(&jobs, atoi(argv[i]));
+	if (job == NULL) {
+	    if ((status = takeended(&jobs, argv[i][0] == '%' ? atoi(argv[i] + 1) : 0, atoi(argv[i]))) < 0) {
+		printf("wait: %s: No such job\n", argv[i]);
+		status = 127;
+	    }
+	    continue;
+	}
+	status = 0;
+	client->waitjids[client->nwait++] = job->jid;
+    }
+    client->status = status;
+    if (argv[1] == NULL || client->nwait > 0)
+	client->waiting = !srv_waitdone(client);
+    if (!client->waiting) {
+	free(client->waitjids);
+	client->waitjids = NULL;
+	return status;
+    }
+
+    /* Like wait, answer with how the last job given ends, if it can tell */
+    if (last != NULL && last->done == NULL) {
+	last->done = srv_waitended;
+	last->data = client;
+    }
+    return status;
+}
+
+/* srv_reply - Copy the answer to one command to stdout, and get its status.
+ *     Returns 0 if the server closed the connection instead (e.g. quit). */
+static int srv_reply(FILE *in, int *status)
+{
+    int ch;
+
+    while ((ch = getc(in)) != EOF && ch != '\0')
+	putchar(ch);
+    fflush(stdout);
+    return ch != EOF && fscanf(in, "%d", status) == 1 && getc(in) == '\n';
+}
+
+/* 
+ * srv_client - Client mode (-C): send the command line made of words,
+ *     or else each line of stdin, to the server at path, and print its
+ *     answers. Returns the exit status of the last command.
+ */
+int srv_client(char *path, char **words)
+{
+    struct sockaddr_un addr;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    int fd, i, status = 0;
+    FILE *in;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+	printf("%s: %s\n", path, strerror(ENAMETOOLONG));
+	return 1;
+    }
+    strcpy(addr.sun_path, path);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 ||
+	connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	printf("%s: %s\n", path, strerror(errno));
+	return 1;
+    }
+    if ((in = fdopen(fd, "r")) == NULL)
+	unix_error("fdopen error");
+    signal(SIGPIPE, SIG_IGN);  /* a server that went away is an error, not a signal */
+
+    if (words[0] != NULL) {  /* the words make up one command line */
+	for (i = 0; words[i] != NULL; i++)
+	    dprintf(fd, "%s%c", words[i], words[i+1] != NULL ? ' ' : '\n');
+	srv_reply(in, &status);
+    }
+    else {
+	while ((n = getline(&line, &cap, stdin)) > 0) {
+	    if (dprintf(fd, "%s%s", line, line[n-1] == '\n' ? "" : "\n") < 0 ||
+		!srv_reply(in, &status))
+		break;
+	}
+	free(line);
+    }
+    fclose(in);
+    return status;
+}
+
+/***************************
+ * End job server routines
+ ***************************/
+
+/*********************
+ * Terminal routines
+ *
+ * When the shell prompts on a terminal, it hands the terminal to the
+ * process group of each foreground job with tcsetpgrp(), so that the
+ * kernel delivers ctrl-c and ctrl-z to the job directly and full
+ * screen programs can read it and change its modes. The job's first
+ * process takes it before exec (see setupchild), so the job never
+ * runs in the background by mistake. When the job stops or is over,
+ * the shell takes the terminal back and restores its own modes; a
+ * stopped job's modes are kept and restored when it is resumed with
+ * fg. Otherwise (-p, -f, or not on a terminal), the shell keeps its
+ * process group and forwards ctrl-c and ctrl-z as before.
+ *********************/
+
+/* 
+ * tty_init - Make the shell the foreground process group of its
+ *     terminal and note its modes. If it was started in the background,
+ *     wait to be brought to the foreground first.
+ */
+void tty_init(void)
+{
+    while (tcgetpgrp(STDIN_FILENO) != (shellpgid = getpgrp()))
+	kill(-shellpgid, SIGTTIN);
+    if (setpgid(0, 0) < 0 && errno != EPERM)  /* EPERM: already a session leader */
+	return;
+    shellpgid = getpgrp();
+    if (tcsetpgrp(STDIN_FILENO, shellpgid) < 0 || tcgetattr(STDIN_FILENO, &shellmodes) < 0)
+	return;
+    interactive = 1;
+}
+
+/* tty_give - Hand the terminal to a foreground job, with its modes if
+ *     it has been in the foreground before */
+void tty_give(struct job_t *job)
+{
+    if (!interactive)
+	return;
+    if (job->hasmodes)
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &job->tmodes);
+    tcsetpgrp(STDIN_FILENO, job->pid);
+}
+
+/* tty_take - Take the terminal back from the foreground job, keeping
+ *     its modes if job is not NULL (it stopped), and restore ours */
+void tty_take(struct job_t *job)
+{
+    if (!interactive)
+	return;
+    tcsetpgrp(STDIN_FILENO, shellpgid);
+    if (job != NULL)
+	job->hasmodes = tcgetattr(STDIN_FILENO, &job->tmodes) == 0;
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &shellmodes);
+}
+
+/*************************
+ * End terminal routines
+ *************************/
+
+/******************
+ * Zygote routines
+ *
+ * With -z, jobs are started by a zygote: a copy of the shell forked
+ * at startup, before it has grown, that does nothing but create
+ * processes on request. It gets each command's argv, environment,
+ * redirections and placement over a UNIX socket, with its working
+ * directory, stdin, stdout and stderr as descriptors (SCM_RIGHTS). It
+ * creates the process with clone(CLONE_PARENT), which makes it a child
+ * of the shell, not of the zygote: the shell reaps it and runs job
+ * control on it as on any other. The new process reports a failure to start
+ * through a close-on-exec pipe, and the zygote sends back its PID and
+ * any error.
+ ******************/
+
+/* 
+ * zread - Read exactly n bytes, returning 0 on EOF or error
+ */
+static int zread(int fd, void *buf, size_t n)
+{
+    ssize_t r;
+    size_t off = 0;
+
+    while (off < n) {
+	if ((r = read(fd, (char *)buf + off, n - off)) <= 0) {
+	    if (r < 0 && errno == EINTR)
+		continue;
+	    return 0;
+	}
+	off += r;
+    }
+    return 1;
+}
+
+/* 
+ * zwrite - Write exactly n bytes, returning 0 on error
+ */
+static int zwrite(int fd, const void *buf, size_t n)
+{
+    ssize_t r;
+    size_t off = 0;
+
+    while (off < n) {
+	if ((r = write(fd, (const char *)buf + off, n - off)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return 0;
+	}
+	off += r;
+    }
+    return 1;
+}
+
+/* 
+ * zchild - Run a requested command in the new process. Only reports
+ *     back through the pipe if it fails.
+ */
+static void zchild(struct stage_t *stage, pid_t pgid, int cwd, char **env, int errfd)
+{
+    struct zreply_t rep;
+    char *what = NULL;
+
+    memset(&rep, 0, sizeof(rep));
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    environ = env;
+    if (fchdir(cwd) < 0 || setupchild(stage, pgid, &what) < 0) {
+	rep.err = errno;
+	rep.whatlen = what != NULL ? strlen(what) : 0;
+	if (what == NULL)
+	    what = "cwd", rep.whatlen = 3;
+	zwrite(errfd, &rep, sizeof(rep));
+	zwrite(errfd, what, rep.whatlen);
+	_exit(127);
+    }
+    if (stage->path != NULL) {
+	execv(stage->path, stage->argv);
+	rep.stale = 1;
+    }
+    execvp(stage->argv[0], stage->argv);
+    rep.err = errno;
+    zwrite(errfd, &rep, sizeof(rep));
+    _exit(127);
+}
+
+/* 
+ * zreport - Read what a process the zygote started reported: nothing
+ *     if it got as far as exec, or why it failed. Forgets leader if it
+ *     was that process and failed.
+ */
+static void zreport(struct zpend_t *pe, pid_t *leader)
+{
+    struct zreply_t crep;
+
+    if (zread(pe->errfd, &crep, sizeof(crep))) {
+	pe->rep.err = crep.err;
+	pe->rep.stale |= crep.stale;
+	if ((pe->rep.whatlen = crep.whatlen) > 0 && (pe->what = malloc(crep.whatlen)) != NULL &&
+	    !zread(pe->errfd, pe->what, crep.whatlen))
+	    pe->rep.whatlen = 0;
+	if (pe->what == NULL)
+	    pe->rep.whatlen = 0;
+	if (pe->rep.pid == *leader)
+	    *leader = 0;
+    }
+    close(pe->errfd);
+    pe->errfd = -1;
+}
+
+/* 
+ * zloop - The zygote's main routine: serve launch requests until the
+ *     shell goes away. A new process's report is not waited for before
+ *     the next request is served, except that a stage joining a group
+ *     waits to learn whether its leader started; the answers go back
+ *     in the order of the requests.
+ */
+static void zloop(int sock)
+{
+    struct zreq_t req;
+    struct zredir_t *zr;
+    struct stage_t stage;
+    struct zpend_t *pend = NULL, *pe;
+    struct pollfd *pfds = NULL;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    union { struct cmsghdr align; char buf[CMSG_SPACE(4 * sizeof(int))]; } ctl;
+    char *data = NULL, *p, **argv, **env;
+    size_t cap = 0, npend = 0, pendcap = 0, k;
+    int fds[4], nfds, i, errpipe[2];
+    pid_t pid, leader = 0;
+
+    while (1) {
+	/* Answer for the processes at the head whose fate is known */
+	for (k = 0; k < npend && pend[k].errfd < 0; k++) {
+	    if (!zwrite(sock, &pend[k].rep, sizeof(pend[k].rep)) ||
+		!zwrite(sock, pend[k].what, pend[k].rep.whatlen))
+		_exit(0);
+	    free(pend[k].what);
+	}
+	memmove(pend, pend + k, (npend - k) * sizeof(*pend));
+	npend -= k;
+
+	/* Wait for a request or a report */
+	if (npend + 1 > pendcap) {
+	    pendcap = 2 * (npend + 1);
+	    if ((pend = realloc(pend, pendcap * sizeof(*pend))) == NULL ||
+		(pfds = realloc(pfds, pendcap * sizeof(*pfds))) == NULL)
+		_exit(1);
+	}
+	pfds[0].fd = sock;
+	pfds[0].events = POLLIN;
+	for (k = 0; k < npend; k++) {
+	    pfds[k + 1].fd = pend[k].errfd;
+	    pfds[k + 1].events = POLLIN;
+	}
+	if (poll(pfds, npend + 1, -1) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    _exit(1);
+	}
+	for (k = 0; k < npend; k++)
+	    if (pfds[k + 1].revents != 0)
+		zreport(&pend[k], &leader);
+	if (pfds[0].revents == 0)
+	    continue;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &req;
+	iov.iov_len = sizeof(req);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+	if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL) != sizeof(req))
+	    _exit(0);
+	nfds = 0;
+	for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+	    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+		nfds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(fds, CMSG_DATA(cm), nfds * sizeof(int));
+	    }
+	if (req.len > cap) {
+	    cap = req.len;
+	    if ((data = realloc(data, cap)) == NULL)
+		_exit(1);
+	}
+	if (nfds != 1 + req.hasin + req.hasout + req.haserr || !zread(sock, data, req.len))
+	    _exit(1);
+
+	/* Unpack the command */
+	argv = malloc((req.nargs + 1) * sizeof(char *));
+	env = malloc((req.nenv + 1) * sizeof(char *));
+	stage.redirs = malloc((req.nredirs + 1) * sizeof(struct redir_t));
+	if (argv == NULL || env == NULL || stage.redirs == NULL)
+	    _exit(1);
+	zr = (struct zredir_t *)data;
+	p = data + req.nredirs * sizeof(*zr);
+	stage.path = *p ? p : NULL;
+	p += strlen(p) + 1;
+	for (i = 0; i < req.nargs; p += strlen(p) + 1)
+	    argv[i++] = p;
+	argv[i] = NULL;
+	for (i = 0; i < req.nenv; p += strlen(p) + 1)
+	    env[i++] = p;
+	env[i] = NULL;
+	for (i = 0; i < req.nredirs; i++) {
+	    stage.redirs[i].fd = zr[i].fd;
+	    stage.redirs[i].flags = zr[i].flags;
+	    stage.redirs[i].dupfd = zr[i].dupfd;
+	    stage.redirs[i].path = NULL;
+	    if (zr[i].haspath) {
+		stage.redirs[i].path = p;
+		p += strlen(p) + 1;
+	    }
+	}
+	stage.argv = argv;
+	stage.nredirs = req.nredirs;
+	stage.infd = req.hasin ? fds[1] : -1;
+	stage.outfd = req.hasout ? fds[1 + req.hasin] : -1;
+	stage.errfd = req.haserr ? fds[1 + req.hasin + req.hasout] : -1;
+	stage.place = req.hasplace ? &req.place : NULL;
+	stage.tty = req.tty;
+
+	/* A stage joins its leader's group only if the leader started */
+	if (req.join)
+	    for (k = 0; k < npend && leader > 0; k++)
+		if (pend[k].rep.pid == leader && pend[k].errfd >= 0)
+		    zreport(&pend[k], &leader);
+
+	/* Start it; its report is read once it comes */
+	pe = &pend[npend++];
+	memset(pe, 0, sizeof(*pe));
+	pe->errfd = -1;
+	if (stage.path != NULL && faccessat(fds[0], stage.path, X_OK, 0) < 0) {
+	    pe->rep.stale = 1;  /* the child can't tell once execvp has found it elsewhere */
+	    stage.path = NULL;
+	}
+	if (pipe2(errpipe, O_CLOEXEC) < 0) {
+	    pid = -1;
+	    pe->rep.err = errno;
+	}
+	else if ((pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0)) == 0)
+	    zchild(&stage, req.join ? leader : 0, fds[0], env, errpipe[1]);
+	else if (pid < 0) {
+	    pe->rep.err = errno;
+	    close(errpipe[0]);
+	    close(errpipe[1]);
+	}
+	else {
+	    close(errpipe[1]);
+	    pe->errfd = errpipe[0];
+	}
+	pe->rep.pid = pid;
+	if (!req.join || leader == 0)  /* as after a failed leader, the next stage leads */
+	    leader = pid > 0 ? pid : 0;
+
+	free(argv);
+	free(env);
+	free(stage.redirs);
+	for (i = 0; i < nfds; i++)
+	    close(fds[i]);
+    }
+}
+
+/* 
+ * zinit - Fork the zygote
+ */
+void zinit(void)
+{
+    int sv[2];
+    sigset_t mask;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+	unix_error("socketpair error");
+    switch (fork()) {
+    case -1:
+	unix_error("fork error");
+    case 0:
+	close(sv[0]);
+	setpgid(0, 0);  /* out of the way of the terminal's ctrl-c and ctrl-z, */
+	signal(SIGINT, SIG_IGN);  /* and of those meant for the shell */
+	signal(SIGTSTP, SIG_IGN);
+	sigprocmask(SIG_SETMASK, NULL, &origmask);
+	sigemptyset(&mask);  /* so that its children can take the terminal, as the shell's do */
+	sigaddset(&mask, SIGTTOU);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	syscall(SYS_close_range, 3, ~0U, 4 /* CLOSE_RANGE_CLOEXEC */);  /* jobs inherit nothing of ours */
+	zloop(sv[1]);
+    }
+    close(sv[1]);
+    zygote = sv[0];
+}
+
+/* 
+ * zsend - Ask the zygote to start a pipeline stage, in a new process
+ *     group or, if join is set, in that of the stage it last started.
+ *     Returns 0, 1 if the stage can't be sent, or -1 if the zygote is
+ *     gone. The socket is then only shut down for writing, so that the
+ *     answers to the stages already sent can still be read; the caller
+ *     closes it.
+ */
+int zsend(struct stage_t *stage, int join)
+{
+    struct zreq_t req;
+    struct zredir_t *zr;
+    struct msghdr msg;
+    struct iovec iov[2];
+    struct cmsghdr *cm;
+    union { struct cmsghdr align; char buf[CMSG_SPACE(4 * sizeof(int))]; } ctl;
+    char *data, *p, **e;
+    int fds[4], nfds = 0, i, ok;
+    ssize_t n;
+
+    memset(&req, 0, sizeof(req));
+    req.join = join;
+    req.len = stage->nredirs * sizeof(*zr) + (stage->path != NULL ? strlen(stage->path) : 0) + 1;
+    for (i = 0; stage->argv[i] != NULL; i++)
+	req.len += strlen(stage->argv[i]) + 1;
+    req.nargs = i;
+    for (e = environ; *e != NULL; e++)
+	req.len += strlen(*e) + 1;
+    req.nenv = e - environ;
+    for (i = 0; i < stage->nredirs; i++)
+	if (stage->redirs[i].path != NULL)
+	    req.len += strlen(stage->redirs[i].path) + 1;
+    req.nredirs = stage->nredirs;
+    req.tty = stage->tty;
+    if (stage->place != NULL) {
+	req.hasplace = 1;
+	req.place = *stage->place;
+    }
+
+    data = arena_alloc(req.len);
+    zr = (struct zredir_t *)data;
+    p = data + stage->nredirs * sizeof(*zr);
+    p = stpcpy(p, stage->path != NULL ? stage->path : "") + 1;
+    for (i = 0; i < req.nargs; i++)
+	p = stpcpy(p, stage->argv[i]) + 1;
+    for (e = environ; *e != NULL; e++)
+	p = stpcpy(p, *e) + 1;
+    for (i = 0; i < stage->nredirs; i++) {
+	zr[i].fd = stage->redirs[i].fd;
+	zr[i].flags = stage->redirs[i].flags;
+	zr[i].dupfd = stage->redirs[i].dupfd;
+	if ((zr[i].haspath = stage->redirs[i].path != NULL))
+	    p = stpcpy(p, stage->redirs[i].path) + 1;
+    }
+
+    if ((fds[nfds++] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC)) < 0)
+	return 1;
+    if ((req.hasin = stage->infd >= 0))
+	fds[nfds++] = stage->infd;
+    if ((req.hasout = stage->outfd >= 0))
+	fds[nfds++] = stage->outfd;
+    if ((req.haserr = stage->errfd >= 0))
+	fds[nfds++] = stage->errfd;
+
+    memset(&msg, 0, sizeof(msg));
+    iov[0].iov_base = &req;
+    iov[0].iov_len = sizeof(req);
+    iov[1].iov_base = data;
+    iov[1].iov_len = req.len;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = ctl.buf;
+    msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+    cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(cm), fds, nfds * sizeof(int));
+
+    /* The descriptors go with the first byte; a long request may take more writes */
+    while ((n = sendmsg(zygote, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+	;
+    ok = n >= 0;
+    if (ok && (size_t)n < sizeof(req) + req.len) {
+	n -= sizeof(req);
+	ok = n >= 0 ? zwrite(zygote, data + n, req.len - n) :
+	    zwrite(zygote, (char *)&req + sizeof(req) + n, -n) && zwrite(zygote, data, req.len);
+    }
+    close(fds[0]);
+    if (!ok) {
+	printf("zygote: %s, launching directly from now on\n", strerror(errno));
+	shutdown(zygote, SHUT_WR);
+	return -1;
+    }
+    return 0;
+}
+
+/* 
+ * zrecv - Get the zygote's answer to the next request, the stage it
+ *     was for. Returns the new process's PID, or -1 after printing why
+ *     it couldn't be started.
+ */
+pid_t zrecv(struct stage_t *stage)
+{
+    struct zreply_t rep;
+    char *what;
+
+    if (zygote < 0 || !zread(zygote, &rep, sizeof(rep)) ||
+	!zread(zygote, (what = arena_alloc(rep.whatlen + 1)), rep.whatlen)) {
+	printf("zygote: %s\n", "no answer");
+	return -1;
+    }
+    what[rep.whatlen] = '\0';
+    if (rep.stale)
+	hashdrop(stage->argv[0]);
+    if (rep.pid < 0) {
+	printf("%s: %s\n", stage->argv[0], strerror(rep.err));
+	return -1;
+    }
+    if (rep.err != 0) {  /* it never becomes a job, so reap it right away */
+	waitpid(rep.pid, NULL, 0);
+	if (rep.whatlen > 0)
+	    printf("%s: %s\n", what, strerror(rep.err));
+	else if (rep.err == ENOENT)
+	    printf("%s: Command not found\n", stage->argv[0]);
+	else
+	    printf("%s: %s\n", stage->argv[0], strerror(rep.err));
+	return -1;
+    }
+    return rep.pid;
+}
+
+/**********************
+ * End zygote routines
+ **********************/
+
+/***********************
+ * Statistics routines
+ *
+ * The phases of command handling are timed with CLOCK_MONOTONIC,
+ * which is read from the vDSO without a system call. Each phase keeps
+ * a count, a sum, a maximum and a histogram of fixed log2 buckets, so
+ * recording a timing takes a few nanoseconds and no memory.
+ ***********************/
+
+/* ph_now - Return the CLOCK_MONOTONIC time in nanoseconds */
+long long ph_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ph_add - Record that phase ph took ns nanoseconds */
+void ph_add(int ph, long long ns)
+{
+    struct phase_t *p = &phases[ph];
+    int b = 0;
+
+    if (ns < 0)
+	ns = 0;
+    if (ns > 0 && (b = 64 - __builtin_clzll(ns)) >= PHBUCKETS)
+	b = PHBUCKETS - 1;
+    p->n++;
+    p->sum += ns;
+    if ((unsigned long long)ns > p->max)
+	p->max = ns;
+    p->hist[b]++;
+}
+
+/* ph_fmt - Format a duration in nanoseconds with a suitable unit */
+static char *ph_fmt(char *buf, double ns)
+{
+    if (ns < 1e3)
+	sprintf(buf, "%.0fns", ns);
+    else if (ns < 1e6)
+	sprintf(buf, "%.1fus", ns / 1e3);
+    else if (ns < 1e9)
+	sprintf(buf, "%.1fms", ns / 1e6);
+    else
+	sprintf(buf, "%.2fs", ns / 1e9);
+    return buf;
+}
+
+/* ph_quantile - Return the upper bound of the bucket holding quantile q
+ *     of a phase's timings, or its maximum if lower */
+static double ph_quantile(struct phase_t *p, double q)
+{
+    unsigned long seen = 0;
+    double bound;
+    int b;
+
+    for (b = 0; b < PHBUCKETS - 1; b++)
+	if ((seen += p->hist[b]) >= q * p->n)
+	    break;
+    bound = b == PHBUCKETS - 1 ? p->max : (double)(1ULL << b);
+    return bound < p->max ? bound : p->max;
+}
+
+/* 
+ * ph_print - Print the count, mean, median, 99th percentile and maximum
+ *     of each phase timed so far, and with verbose its histogram. The
+ *     percentiles are bucket bounds, so within a factor of 2.
+ */
+void ph_print(int verbose)
+{
+    struct phase_t *p;
+    char b1[32], b2[32], b3[32], b4[32];
+    int b;
+
+    printf("%-10s %10s %9s %9s %9s %9s\n", "phase", "count", "mean", "p50", "p99", "max");
+    for (p = phases; p < phases + NPHASES; p++) {
+	if (p->n == 0) {
+	    printf("%-10s %10d\n", p->name, 0);
+	    continue;
+	}
+	printf("%-10s %10lu %9s %9s %9s %9s\n", p->name, p->n, ph_fmt(b1, (double)p->sum / p->n),
+	       ph_fmt(b2, ph_quantile(p, 0.5)), ph_fmt(b3, ph_quantile(p, 0.99)), ph_fmt(b4, p->max));
+	if (!verbose)
+	    continue;
+	printf("    %s\n", p->what);
+	for (b = 0; b < PHBUCKETS; b++)
+	    if (p->hist[b] > 0)
+		printf("    < %-9s %10lu\n", b == PHBUCKETS - 1 ? "inf" : ph_fmt(b1, (double)(1ULL << b)),
+		       p->hist[b]);
+    }
+}
+
+/* ph_reset - Start the timings over */
+void ph_reset(void)
+{
+    struct phase_t *p;
+
+    for (p = phases; p < phases + NPHASES; p++) {
+	p->n = p->sum = p->max = 0;
+	memset(p->hist, 0, sizeof(p->hist));
+    }
+}
+
+/* ph_exit - Print the timings when the shell exits (-S), not when a
+ *     child that failed to exec does */
+void ph_exit(void)
+{
+    if (getpid() == statspid)
+	ph_print(1);
+}
+
+/***************************
+ * End statistics routines
+ ***************************/
+
+/*************************
+ * Command arena routines
+ *
+ * Everything built while evaluating one command line (its copy, argv,
+ * the pipeline) is carved out of the arena and released at once when
+ * the command is done.
+ *************************/
+
+/* arena_alloc - Allocate size bytes that live until the next arena_reset() */
+void *arena_alloc(size_t size)
+{
+    struct chunk_t *c = arena;
+    size_t cap;
+
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    if (c == NULL || c->cap - c->used < size) {
+	cap = size > ARENACHUNK ? size : ARENACHUNK;
+	if ((c = malloc(sizeof(*c) + cap)) == NULL)
+	    unix_error("malloc error");
+	c->used = 0;
+	c->cap = cap;
+	c->next = arena;
+	arena = c;
+    }
+    c->used += size;
+    return c->data + c->used - size;
+}
+
+/* arena_reset - Free everything allocated from the arena, keeping one chunk */
+void arena_reset(void)
+{
+    struct chunk_t *c;
+
+    if (arena == NULL)
+	return;
+    while ((c = arena->next) != NULL) {
+	arena->next = c->next;
+	free(c);
+    }
+    if (arena->cap > ARENACHUNK) { /* don't hold on to a huge line */
+	free(arena);
+	arena = NULL;
+	return;
+    }
+    arena->used = 0;
+}
+
+/* arena_mark - Remember how far the arena is used, for arena_release() */
+void arena_mark(struct amark_t *m)
+{
+    m->chunk = arena;
+    m->used = arena != NULL ? arena->used : 0;
+}
+
+/* arena_release - Free what was allocated from the arena since arena_mark(m) */
+void arena_release(struct amark_t *m)
+{
+    struct chunk_t *c;
+
+    while ((c = arena) != m->chunk) {
+	arena = c->next;
+	free(c);
+    }
+    if (arena != NULL)
+	arena->used = m->used;
+}
+/*****************************
+ * End command arena routines
+ *****************************/
+
+
+/**********************
+ * Event loop routines
+ **********************/
+
+/* Deleted sources are freed after the current dispatch round, since
+ * later events of the same round may still point at them */
+static struct evsrc_t *evfree = NULL;
+
+/*
+ * ev_init - Create the epoll instance and route SIGCHLD, SIGINT and
+ *     SIGTSTP through a signalfd watched by it
+ */
+void ev_init(void)
+{
+    int sigfd;
+
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	unix_error("epoll_create1 error");
+
+    sigemptyset(&shellmask);
+    sigaddset(&shellmask, SIGCHLD);
+    sigaddset(&shellmask, SIGINT);
+    sigaddset(&shellmask, SIGTSTP);
+    sigaddset(&shellmask, SIGTTOU);  /* only blocked, so that tcsetpgrp() works from the background */
+    if (sigprocmask(SIG_BLOCK, &shellmask, &origmask) < 0)
+	unix_error("sigprocmask error");
+    if ((sigfd = signalfd(-1, &shellmask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+	unix_error("signalfd error");
+    ev_add(sigfd, EPOLLIN, sigfd_ready, NULL);
+}
+
+/* ev_add - Watch fd for events, calling fn(fd, arg) when it is ready */
+struct evsrc_t *ev_add(int fd, int events, evhandler_t *fn, void *arg)
+{
+    struct epoll_event ev;
+    struct evsrc_t *src;
+
+    if ((src = malloc(sizeof(*src))) == NULL)
+	unix_error("malloc error");
+    src->fd = fd;
+    src->fn = fn;
+    src->arg = arg;
+    src->next = NULL;
+
+    ev.events = events;
+    ev.data.ptr = src;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+	free(src);
+	return NULL;
+    }
+    return src;
+}
+
+/* ev_del - Stop watching a source; the caller still owns src->fd */
+void ev_del(struct evsrc_t *src)
+{
+    epoll_ctl(epfd, EPOLL_CTL_DEL, src->fd, NULL);
+    src->fn = NULL;
+    src->next = evfree;
+    evfree = src;
+}
+
+/* 
+ * ev_timer - Call fn once after ms milliseconds, or every ms
+ *     milliseconds if periodic is set. Cancel with ev_del() and
+ *     close() of the returned source's fd.
+ */
+struct evsrc_t *ev_timer(long ms, int periodic, evhandler_t *fn, void *arg)
+{
+    struct itimerspec its;
+    struct evsrc_t *src;
+    int fd;
+
+    if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+	return NULL;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = ms / 1000;
+    its.it_value.tv_nsec = (ms % 1000) * 1000000;
+    if (periodic)
+	its.it_interval = its.it_value;
+    if (timerfd_settime(fd, 0, &its, NULL) < 0 ||
+	(src = ev_add(fd, EPOLLIN, fn, arg)) == NULL) {
+	close(fd);
+	return NULL;
+    }
+    return src;
+}
+
+/* 
+ * ev_wait - Wait up to timeout milliseconds (-1 forever) for events
+ *     and dispatch them to their handlers
+ */
+void ev_wait(int timeout)
+{
+    struct epoll_event evs[MAXEVENTS];
+    struct evsrc_t *src;
+    int i, n;
+
+    if ((n = epoll_wait(epfd, evs, MAXEVENTS, timeout)) < 0) {
+	if (errno == EINTR)
+	    return;
+	unix_error("epoll_wait error");
+    }
+    for (i = 0; i < n; i++) {
+	src = evs[i].data.ptr;
+	if (src->fn != NULL)
+	    src->fn(src->fd, src->arg);
+    }
+    while ((src = evfree) != NULL) {
+	evfree = src->next;
+	free(src);
+    }
+}
+
+/* 
+ * sigfd_ready - Drain the signalfd and run the handler of each signal
+ *     that arrived. SIGCHLD is handled once per batch since one call
+ *     of sigchld_handler reaps every waiting child (up to the size of
+ *     its ring), followed by chld_drain to process them.
+ */
+void sigfd_ready(int fd, void *arg)
+{
+    struct signalfd_siginfo si[16];
+    ssize_t n;
+    int i, chld = 0, full;
+    long long t0 = ph_now();
+
+    while ((n = read(fd, si, sizeof(si))) > 0) {
+	for (i = 0; i < n / (ssize_t)sizeof(si[0]); i++) {
+	    switch (si[i].ssi_signo) {
+	    case SIGCHLD:
+		chld = 1;
+		break;
+	    case SIGINT:
+		sigint_handler(SIGINT);
+		break;
+	    case SIGTSTP:
+		sigtstp_handler(SIGTSTP);
+		break;
+	    }
+	}
+    }
+    /* If the ring filled up, more children may be waiting, and their
+     * SIGCHLD has already been consumed: keep reaping until it doesn't */
+    if (chld) {
+	chldat = t0;
+	do {
+	    sigchld_handler(SIGCHLD);
+	    full = chldhead - chldtail == CHLDRING;
+	    chld_drain();
+	} while (full);
+	ph_add(PH_SIGCHLD, ph_now() - t0);
+    }
+}
+
+/* lb_ready - Event loop callback: the line buffer's fd is readable */
+static void lb_ready(int fd, void *arg)
+{
+    ((struct linebuf_t *)arg)->ready = 1;
+}
+
+/* lb_init - Initialize a line buffer reading from fd */
+void lb_init(struct linebuf_t *lb, int fd)
+{
+    lb->fd = fd;
+    lb->cap = INBUFSZ;
+    lb->linecap = 0;
+    lb->line = NULL;
+    if ((lb->buf = malloc(lb->cap)) == NULL)
+	unix_error("malloc error");
+    lb->start = lb->end = 0;
+    lb->eof = 0;
+    lb->ready = 0;
+    /* Regular files can't be watched by epoll (EPERM); they are
+     * always readable, so they are simply read directly */
+    lb->src = ev_add(fd, EPOLLIN | EPOLLONESHOT, lb_ready, lb);
+}
+
+/* lb_free - Release a line buffer, leaving its fd open */
+void lb_free(struct linebuf_t *lb)
+{
+    if (lb->src != NULL)
+	ev_del(lb->src);
+    free(lb->buf);
+    free(lb->line);
+}
+
+/* 
+ * lb_getline - Return the next line of input, including its '\n',
+ *     or NULL at end of file. Lines may be of any length. While waiting
+ *     for input the event loop keeps running, so children are reaped
+ *     and signals handled; stdout is flushed before that, since the
+ *     shell may be waiting for a reply to what it printed.
+ */
+char *lb_getline(struct linebuf_t *lb)
+{
+    struct epoll_event ev;
+    char *line, *nl;
+    size_t len;
+    ssize_t n;
+    long long t0 = ph_now(), t1;
+
+    while (1) {
+	len = lb->end - lb->start;
+	line = lb->buf + lb->start;
+	if ((nl = memchr(line, '\n', len)) != NULL || (lb->eof && len > 0)) {
+	    if (nl != NULL)
+		len = nl - line + 1;
+	    if (len + 2 > lb->linecap) {
+		lb->linecap = len + 2;
+		if ((lb->line = realloc(lb->line, lb->linecap)) == NULL)
+		    unix_error("realloc error");
+	    }
+	    memcpy(lb->line, line, len);
+	    lb->start += len;
+	    if (lb->line[len-1] != '\n')
+		lb->line[len++] = '\n'; /* last line lacks a newline */
+	    lb->line[len] = '\0';
+	    ph_add(PH_READ, ph_now() - t0);
+	    return lb->line;
+	}
+	if (lb->eof)
+	    return NULL;
+
+	/* Compact, or grow the buffer for a line longer than it */
+	if (lb->start > 0) {
+	    memmove(lb->buf, lb->buf + lb->start, len);
+	    lb->start = 0;
+	    lb->end = len;
+	}
+	else if (lb->end == lb->cap) {
+	    lb->cap *= 2;
+	    if ((lb->buf = realloc(lb->buf, lb->cap)) == NULL)
+		unix_error("realloc error");
+	}
+
+	if (lb->src != NULL) {
+	    fflush(stdout);
+	    lb->ready = 0;
+	    ev.events = EPOLLIN | EPOLLONESHOT;
+	    ev.data.ptr = lb->src;
+	    epoll_ctl(epfd, EPOLL_CTL_MOD, lb->fd, &ev);
+	    t1 = ph_now();
+	    while (!lb->ready)
+		ev_wait(-1);
+	    t0 += ph_now() - t1;  /* the time spent waiting doesn't count */
+	}
+	if ((n = read(lb->fd, lb->buf + lb->end, lb->cap - lb->end)) < 0) {
+	    if (errno == EINTR || errno == EAGAIN)
+		continue;
+	    app_error("read error");
+	}
+	if (n == 0)
+	    lb->eof = 1;
+	lb->end += n;
+    }
+}
+/**************************
+ * End event loop routines
+ **************************/
+
+
+/***********************
+ * Other helper routines
+ ***********************/
+
+/*
+ * usage - print a help message
+ */
+void usage(void) 
+{
+    printf("Usage: shell [-hvpFzS] [-f script] [-e fd] [-b size] [-s socket]\n");
+    printf("       shell -C socket [command line]\n");
+    printf("   -h   print this message\n");
+    printf("   -v   print additional diagnostic information\n");
+    printf("   -p   do not emit a command prompt\n");
+    printf("   -F   launch jobs with fork() instead of vfork()\n");
+    printf("   -z   launch jobs through a zygote process forked at startup\n");
+    printf("   -S   print the timings of the stats builtin at exit\n");
+    printf("   -f   run the commands of a script file instead of stdin\n");
+    printf("   -e   write job events as JSON lines to descriptor fd\n");
+    printf("   -b   capture the output of background jobs, keeping the last size bytes (k, M) in memory\n");
+    printf("   -s   also run command lines sent by clients over a UNIX socket\n");
+    printf("   -C   send a command line (or each line of stdin) to a server and print its answers\n");
+    exit(1);
+}
+
+/*
+ * unix_error - unix-style error routine
+ */
+void unix_error(char *msg)
+{
+    fprintf(stdout, "%s: %s\n", msg, strerror(errno));
+    exit(1);
+}
+
+/*
+ * app_error - application-style error routine
+ */
+void app_error(char *msg)
+{
+    fprintf(stdout, "%s\n", msg);
+    exit(1);
+}
+
+/*
+ * Signal - wrapper for the sigaction function
+ */
+handler_t *Signal(int signum, handler_t *handler) 
+{
+    struct sigaction action, old_action;
+
+    action.sa_handler = handler;  
+    sigemptyset(&action.sa_mask); /* block sigs of type being handled */
+    action.sa_flags = SA_RESTART; /* restart syscalls if possible */
+
+    if (sigaction(signum, &action, &old_action) < 0)
+	unix_error("Signal error");
+    return (old_action.sa_handler);
+}
+
+/*
+ * sigquit_handler - The driver program can gracefully terminate the
+ *    child shell by sending it a SIGQUIT signal.
+ */
+void sigquit_handler(int sig) 
+{
+    printf("Terminating after receipt of SIGQUIT signal\n");
+    exit(1);
+}
+
+
+